@@ -32,19 +32,25 @@
 #define BPGM_CLASSES(K) FOR_EACH_BPGM(pgm::BucketingPGMIndex, K)
 #define EFPGM_CLASSES(K) FOR_EACH_EPS(pgm::EliasFanoPGMIndex, K)
 #define CPGM_CLASSES(K) FOR_EACH_EPS(pgm::CompressedPGMIndex, K)
+#define QPGM_CLASSES(K) FOR_EACH_EPS(pgm::QuadraticPGMIndex, K)
 
-#define ALL_CLASSES(K) PGM_CLASSES(K), BPGM_CLASSES(K), EFPGM_CLASSES(K), CPGM_CLASSES(K)
+#define ALL_CLASSES(K) PGM_CLASSES(K), BPGM_CLASSES(K), EFPGM_CLASSES(K), CPGM_CLASSES(K), QPGM_CLASSES(K)
+#define TLB_CLASSES(K) PGM_CLASSES(K)
 
 template<typename K>
 void read_ints_helper(args::PositionalList<std::string> &files,
                       size_t record_size,
                       double lookup_ratio,
-                      const std::string &workload) {
+                      const std::string &workload,
+                      bool tlb) {
     OUT_VERBOSE("Running with " << sizeof(K) << "-byte keys + " << record_size - sizeof(K) << "-byte values")
     for (const auto &file : files.Get()) {
         auto data = to_records(read_data_binary<K>(file, true), record_size);
         auto filename = file.substr(file.find_last_of("/\\") + 1);
-        benchmark_all<K, ALL_CLASSES(K)>(filename, data, record_size, lookup_ratio, workload);
+        if (tlb)
+            benchmark_tlb<K, TLB_CLASSES(K)>(filename, data, record_size, lookup_ratio, workload);
+        else
+            benchmark_all<K, ALL_CLASSES(K)>(filename, data, record_size, lookup_ratio, workload);
     }
 }
 
@@ -60,6 +66,7 @@ int main(int argc, char **argv) {
     HelpFlag help(p, "help", "Display this help menu", {'h', "help"});
     Flag verbose(p, "", "Verbose output", {'v', "verbose"});
     ValueFlag<size_t> value_size(p, "bytes", "Size of the values associated to keys", {'V', "values"}, 0);
+    Flag tlb(p, "", "Compare the dTLB misses of PGMIndex with regular and huge pages", {'T', "tlb"});
 
     Group g1(p, "QUERY WORKLOAD OPTIONS (mutually exclusive):", Group::Validators::AtMostOne);
     ValueFlag<double> ratio(g1, "ratio", "Random workload with the given lookup ratio", {'r', "ratio"}, 0.333);
@@ -99,7 +106,10 @@ int main(int argc, char **argv) {
     }
 
     global_verbose = verbose.Get();
-    std::cout << "dataset,class_name,build_ms,bytes,query_ns" << std::endl;
+    if (tlb.Get())
+        std::cout << "dataset,class_name,pages,bytes,query_ns,dtlb_misses_per_query" << std::endl;
+    else
+        std::cout << "dataset,class_name,build_ms,bytes,query_ns" << std::endl;
 
     if (synthetic) {
         auto record_size = value_size.Get() + sizeof(uint64_t);
@@ -120,14 +130,19 @@ int main(int argc, char **argv) {
         };
         OUT_VERBOSE("Generating " << to_metric(n) << " elements (8-byte keys + " << value_size.Get() << "-byte values)")
         OUT_VERBOSE("Total memory for data is " << to_metric(n * record_size, 2, true) << "B")
-        for (auto&[name, gen_data] : distributions)
-            benchmark_all<uint64_t, ALL_CLASSES(uint64_t)>(name, gen_data(), record_size, ratio.Get(), workload.Get());
+        for (auto&[name, gen_data] : distributions) {
+            auto data = gen_data();
+            if (tlb.Get())
+                benchmark_tlb<uint64_t, TLB_CLASSES(uint64_t)>(name, data, record_size, ratio.Get(), workload.Get());
+            else
+                benchmark_all<uint64_t, ALL_CLASSES(uint64_t)>(name, data, record_size, ratio.Get(), workload.Get());
+        }
     }
 
     if (i64.Get())
-        read_ints_helper<int64_t>(files, value_size.Get() + sizeof(int64_t), ratio.Get(), workload.Get());
+        read_ints_helper<int64_t>(files, value_size.Get() + sizeof(int64_t), ratio.Get(), workload.Get(), tlb.Get());
     if (u64.Get())
-        read_ints_helper<uint64_t>(files, value_size.Get() + sizeof(uint64_t), ratio.Get(), workload.Get());
+        read_ints_helper<uint64_t>(files, value_size.Get() + sizeof(uint64_t), ratio.Get(), workload.Get(), tlb.Get());
 
     return 0;
 }
\ No newline at end of file
@@ -15,6 +15,8 @@
 
 #pragma once
 
+#include "pgm/allocator.hpp"
+
 #include <sys/stat.h>
 #include <algorithm>
 #include <cassert>
@@ -32,6 +34,13 @@
 #include <type_traits>
 #include <vector>
 
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 bool global_verbose = false;
 
 #define IF_VERBOSE(X) if (global_verbose) { X; }
@@ -132,6 +141,58 @@ std::string demangle(const char *name) {
 std::string demangle(const char* name) { return name; }
 #endif
 
+/** A counter of the data TLB misses caused by the calling thread, if the OS allows reading it. */
+class TLBMissCounter {
+    int fd = -1;
+
+public:
+    TLBMissCounter() {
+#ifdef __linux__
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB
+            | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+            | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+
+    ~TLBMissCounter() {
+#ifdef __linux__
+        if (fd != -1)
+            close(fd);
+#endif
+    }
+
+    bool available() const { return fd != -1; }
+
+    void start() {
+#ifdef __linux__
+        if (fd != -1) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    /** Stops the counter and returns the number of misses since @ref start, or 0 if the counter is not available. */
+    uint64_t stop() {
+        uint64_t count = 0;
+#ifdef __linux__
+        if (fd != -1) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &count, sizeof(count)) != sizeof(count))
+                count = 0;
+        }
+#endif
+        return count;
+    }
+};
+
 template<typename T>
 class RecordIterator {
     const char *ptr;
@@ -256,6 +317,16 @@ struct type_wrapper { using type = T; };
 template<typename... Ts, typename TF>
 void for_types(TF &&f) { (f(type_wrapper<Ts>{}), ...); }
 
+template<typename K, typename RandomIt>
+std::vector<K> get_queries(RandomIt begin, RandomIt end, double lookup_ratio, const std::string &workload) {
+    if (!workload.empty())
+        return read_data_binary<K>(workload, false);
+    auto queries = generate_queries(begin, end, lookup_ratio);
+    auto m = queries.size();
+    OUT_VERBOSE("Generated " << to_metric(m) << " queries, " << to_metric(m * lookup_ratio) << " are lookups")
+    return queries;
+}
+
 template<typename K, typename... Args>
 void benchmark_all(const std::string &filename,
                    const std::vector<char> &data,
@@ -264,15 +335,7 @@ void benchmark_all(const std::string &filename,
                    const std::string &workload) {
     auto begin = RecordIterator<K>(data.data(), record_size);
     auto end = RecordIterator<K>(data.data() + data.size(), record_size);
-
-    std::vector<K> queries;
-    if (!workload.empty())
-        queries = read_data_binary<K>(workload, false);
-    else {
-        queries = generate_queries(begin, end, lookup_ratio);
-        auto m = queries.size();
-        OUT_VERBOSE("Generated " << to_metric(m) << " queries, " << to_metric(m * lookup_ratio) << " are lookups")
-    }
+    auto queries = get_queries<K>(begin, end, lookup_ratio, workload);
 
     for_types<Args...>([&](auto t) {
         using class_type = typename decltype(t)::type;
@@ -280,4 +343,48 @@ void benchmark_all(const std::string &filename,
         auto[build_ms, query_ns, bytes] = benchmark<class_type>(begin, end, queries);
         std::cout << filename << ",\"" << name << "\"," << build_ms << "," << bytes << "," << query_ns << std::endl;
     });
-}
\ No newline at end of file
+}
+
+/**
+ * Measures the time and the dTLB misses of the index search (without the final search on the data) of each class, with
+ * the segments backed by regular pages, transparent huge pages and explicit huge pages.
+ */
+template<typename K, typename... Args>
+void benchmark_tlb(const std::string &filename,
+                   const std::vector<char> &data,
+                   size_t record_size,
+                   double lookup_ratio,
+                   const std::string &workload) {
+    auto begin = RecordIterator<K>(data.data(), record_size);
+    auto end = RecordIterator<K>(data.data() + data.size(), record_size);
+    auto queries = get_queries<K>(begin, end, lookup_ratio, workload);
+
+    TLBMissCounter counter;
+    if (!counter.available())
+        std::cerr << "Could not open the dTLB miss counter, check /proc/sys/kernel/perf_event_paranoid" << std::endl;
+
+    std::pair<pgm::PagePolicy, const char *> policies[] = {{pgm::PagePolicy::Regular, "regular"},
+                                                           {pgm::PagePolicy::TransparentHugePages, "thp"},
+                                                           {pgm::PagePolicy::HugePages, "hugetlb"}};
+    for_types<Args...>([&](auto t) {
+        using class_type = typename decltype(t)::type;
+        auto name = demangle(typeid(class_type).name());
+        for (auto[policy, policy_name] : policies) {
+            class_type index(begin, end, policy);
+
+            auto t0 = timer::now();
+            counter.start();
+            uint64_t cnt = 0;
+            for (auto &q : queries)
+                cnt += index.search(q).pos;
+            [[maybe_unused]] volatile auto tmp = cnt;
+            auto misses = counter.stop();
+            auto t1 = timer::now();
+
+            auto query_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / queries.size();
+            auto misses_per_query = double(misses) / queries.size();
+            std::cout << filename << ",\"" << name << "\"," << policy_name << "," << index.size_in_bytes() << ","
+                      << query_ns << "," << (counter.available() ? std::to_string(misses_per_query) : "") << std::endl;
+        }
+    });
+}
@@ -0,0 +1,197 @@
+// This file is part of PGM-index <https://github.com/gvinciguerra/PGM-index>.
+// Copyright (c) 2021 Giorgio Vinciguerra.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "benchmark.hpp"
+#include "args.hxx"
+#include "pgm/pgm_index.hpp"
+
+#include <algorithm>
+#include <ctime>
+#include <functional>
+#include <utility>
+
+#ifndef _OPENMP
+#define omp_set_num_threads(t) ((void) (t))
+#endif
+
+#define FOR_EACH_BUILD_CONFIG(F, K) F(K, 16, 4) F(K, 64, 4) F(K, 256, 4) F(K, 1024, 4) F(K, 64, 0) F(K, 64, 16)
+
+/** Measures the resident memory of the process, and its peak since the last call to @ref reset_peak. */
+class MemoryUsage {
+    static size_t read_status_kb(const std::string &field) {
+        std::ifstream in("/proc/self/status");
+        std::string line;
+        while (std::getline(in, line))
+            if (line.compare(0, field.size(), field) == 0 && line[field.size()] == ':')
+                return std::stoull(line.substr(field.size() + 1));
+        return 0;
+    }
+
+public:
+    /** Resets the peak resident memory to the current one. Requires Linux 4.0 or later. */
+    static void reset_peak() { std::ofstream("/proc/self/clear_refs") << "5"; }
+
+    /** Returns the resident memory in bytes, or 0 if it cannot be read. */
+    static size_t current() { return read_status_kb("VmRSS") * 1024; }
+
+    /** Returns the peak resident memory in bytes, or 0 if it cannot be read. */
+    static size_t peak() { return read_status_kb("VmHWM") * 1024; }
+};
+
+/** Returns the CPU time consumed by all the threads of the process, in nanoseconds. */
+uint64_t process_cpu_ns() {
+    timespec ts{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+template<typename K, size_t Epsilon, size_t EpsilonRecursive>
+void benchmark_build(const std::string &dataset, const std::vector<K> &data,
+                     const std::vector<int> &threads, size_t repetitions) {
+    for (auto t : threads) {
+        omp_set_num_threads(t);
+        for (size_t r = 0; r < repetitions; ++r) {
+            MemoryUsage::reset_peak();
+            auto rss_before = MemoryUsage::current();
+            auto cpu_start = process_cpu_ns();
+            auto wall_start = timer::now();
+            pgm::PGMIndex<K, Epsilon, EpsilonRecursive> index(data.begin(), data.end());
+            auto wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(timer::now() - wall_start).count();
+            auto cpu_ns = process_cpu_ns() - cpu_start;
+            auto peak = MemoryUsage::peak();
+
+            std::cout << dataset << "," << demangle(typeid(K).name()) << "," << data.size() << ","
+                      << Epsilon << "," << EpsilonRecursive << "," << t << "," << r << ","
+                      << wall_ns / 1e6 << "," << cpu_ns / 1e6 << "," << (peak > rss_before ? peak - rss_before : 0)
+                      << "," << index.segments_count() << "," << index.size_in_bytes() << std::endl;
+        }
+    }
+}
+
+template<typename K>
+void benchmark_builds(const std::string &dataset, const std::vector<K> &data,
+                      const std::vector<int> &threads, size_t repetitions) {
+    OUT_VERBOSE("Building on " << dataset << " with " << to_metric(data.size()) << " keys")
+#define BENCHMARK_BUILD(K, E, ER) benchmark_build<K, E, ER>(dataset, data, threads, repetitions);
+    FOR_EACH_BUILD_CONFIG(BENCHMARK_BUILD, K)
+#undef BENCHMARK_BUILD
+}
+
+template<typename K>
+void benchmark_synthetic(size_t n, const std::vector<std::string> &names,
+                         const std::vector<int> &threads, size_t repetitions) {
+    std::mt19937_64 generator(42);
+    auto max = std::numeric_limits<K>::max();
+    auto gen = [&](auto distribution) {
+        std::vector<K> out(n);
+        std::generate(out.begin(), out.end(), [&] { return K(distribution(generator)); });
+        std::sort(out.begin(), out.end());
+        return out;
+    };
+
+    using D = std::conditional_t<std::is_signed_v<K>, int64_t, uint64_t>;
+    auto dense_max = D(std::min<double>(max, n * 1000.));
+    auto sparse_max = D(std::min<double>(max, double(n) * n));
+    std::vector<std::pair<std::string, std::function<std::vector<K>()>>> distributions = {
+        {"uniform_dense", std::bind(gen, std::uniform_int_distribution<D>(0, dense_max))},
+        {"uniform_sparse", std::bind(gen, std::uniform_int_distribution<D>(0, sparse_max))},
+        {"lognormal", std::bind(gen, [ln = std::lognormal_distribution<double>(0, 2), scale = dense_max / 1000.,
+                                      max](auto &g) mutable { return D(std::min<double>(ln(g) * scale, max)); })},
+        {"geometric", std::bind(gen, std::geometric_distribution<D>(std::min(1.0, 1000. / sparse_max)))},
+    };
+
+    for (auto &[name, gen_data] : distributions) {
+        if (!names.empty() && std::find(names.begin(), names.end(), name) == names.end())
+            continue;
+        auto data = gen_data();
+        benchmark_builds<K>(name, data, threads, repetitions);
+    }
+}
+
+int main(int argc, char **argv) {
+    using namespace args;
+    ArgumentParser p("Benchmark for the construction of the PGM-index.");
+    p.helpParams.flagindent = 2;
+    p.helpParams.helpindent = 25;
+    p.helpParams.progindent = 0;
+    p.helpParams.descriptionindent = 0;
+
+    CompletionFlag completion(p, {"complete"});
+    HelpFlag help(p, "help", "Display this help menu", {'h', "help"});
+    Flag verbose(p, "", "Verbose output", {'v', "verbose"});
+    ValueFlagList<size_t> sizes(p, "size", "Number of synthetic keys, can be repeated", {'n', "size"}, {1000000});
+    ValueFlagList<int> threads(p, "threads", "Number of threads, can be repeated, each count runs once in "
+                               "increasing order", {'t', "threads"});
+    ValueFlagList<std::string> keys(p, "type", "Key type among u32, u64, i64, can be repeated", {'k', "key"}, {"u64"});
+    ValueFlagList<std::string> distributions(p, "name", "Synthetic distribution among uniform_dense, "
+                                             "uniform_sparse, lognormal, geometric, can be repeated",
+                                             {'d', "distribution"});
+    ValueFlag<size_t> repetitions(p, "count", "Number of builds for each configuration", {'r', "repetitions"}, 3);
+    Flag u64(p, "", "Input files contain unsigned 64-bit ints, instead of generating synthetic data", {'U', "u64"});
+    PositionalList<std::string> files(p, "file", "The input files");
+
+    try {
+        p.ParseCLI(argc, argv);
+    }
+    catch (args::Completion &e) {
+        std::cout << e.what();
+        return 0;
+    }
+    catch (args::Help &) {
+        std::cout << p;
+        return 0;
+    }
+    catch (args::Error &e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << p;
+        return 1;
+    }
+
+    global_verbose = verbose.Get();
+    auto thread_counts = threads.Get();
+    if (thread_counts.empty())
+        thread_counts = {1, omp_get_max_threads()};
+    std::sort(thread_counts.begin(), thread_counts.end());
+    thread_counts.erase(std::unique(thread_counts.begin(), thread_counts.end()), thread_counts.end());
+
+    std::cout << "dataset,key_type,n,epsilon,epsilon_recursive,threads,run,"
+                 "wall_ms,cpu_ms,peak_rss_bytes,segments,bytes" << std::endl;
+
+    if (u64) {
+        for (const auto &file : files.Get()) {
+            auto data = read_data_binary<uint64_t>(file, true);
+            auto filename = file.substr(file.find_last_of("/\\") + 1);
+            benchmark_builds<uint64_t>(filename, data, thread_counts, repetitions.Get());
+        }
+        return 0;
+    }
+
+    for (auto n : sizes.Get()) {
+        for (const auto &key : keys.Get()) {
+            if (key == "u32")
+                benchmark_synthetic<uint32_t>(n, distributions.Get(), thread_counts, repetitions.Get());
+            else if (key == "u64")
+                benchmark_synthetic<uint64_t>(n, distributions.Get(), thread_counts, repetitions.Get());
+            else if (key == "i64")
+                benchmark_synthetic<int64_t>(n, distributions.Get(), thread_counts, repetitions.Get());
+            else {
+                std::cerr << "Unknown key type " << key << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
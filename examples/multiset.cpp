@@ -22,30 +22,15 @@ public:
 
     explicit PGMMultiset(const std::vector<K> &data) : data(data), pgm(data.begin(), data.end()) {}
 
-    bool contains(const K x) const {
-        auto range = pgm.search(x);
-        return std::binary_search(data.begin() + range.lo, data.begin() + range.hi, x);
-    }
+    bool contains(const K x) const { return pgm.contains(data, x); }
 
-    auto lower_bound(const K x) const {
-        auto range = pgm.search(x);
-        return std::lower_bound(data.begin() + range.lo, data.begin() + range.hi, x);
-    }
+    auto lower_bound(const K x) const { return pgm.lower_bound(data, x); }
 
-    auto upper_bound(const K x) const {
-        auto range = pgm.search(x);
-        auto it = std::upper_bound(data.begin() + range.lo, data.begin() + range.hi, x);
-        auto step = 1ull;
-        while (it + step < end() && *(it + step) == x)  // exponential search to skip duplicates
-            step *= 2;
-        return std::upper_bound(it + (step / 2), std::min(it + step, end()), x);
-    }
+    auto upper_bound(const K x) const { return pgm.upper_bound(data, x); }
 
     size_t count(const K x) const {
-        auto lb = lower_bound(x);
-        if (lb == end() || *lb != x)
-            return 0;
-        return std::distance(lb, upper_bound(x));
+        auto[lb, ub] = pgm.equal_range(data, x);
+        return std::distance(lb, ub);
     }
 
     auto begin() const { return data.cbegin(); }
@@ -0,0 +1,143 @@
+// This file is part of PGM-index <https://github.com/gvinciguerra/PGM-index>.
+// Copyright (c) 2018 Giorgio Vinciguerra.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+
+namespace pgm {
+
+/** The kind of memory pages that back the storage of an index. */
+enum class PagePolicy {
+    Regular,              ///< Regular pages, the storage is aligned to a cache line.
+    TransparentHugePages, ///< Storage aligned to a huge page and marked as eligible for transparent huge pages.
+    HugePages             ///< Explicit huge pages from the kernel pool, or transparent huge pages if none is free.
+};
+
+/**
+ * An allocator whose blocks start at a cache line boundary and, depending on a @ref PagePolicy chosen at construction
+ * time, are backed by huge pages to reduce the TLB misses of searches over large arrays.
+ *
+ * Huge pages are used only for blocks of at least @ref huge_page_size bytes, so that small indexes do not waste space.
+ * On systems that do not support huge pages, the policy falls back to regular pages. On systems other than Unix-like
+ * ones, which lack mmap, the policy is ignored and all blocks are allocated with the aligned operator new.
+ *
+ * @tparam T the type of the allocated objects
+ */
+template<typename T>
+class AlignedAllocator {
+    template<typename>
+    friend class AlignedAllocator;
+
+    PagePolicy policy;
+
+#if defined(__unix__) || defined(__APPLE__)
+    static size_t round_to_huge_page(size_t bytes) {
+        return (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+    }
+
+    bool uses_huge_pages(size_t bytes) const { return policy != PagePolicy::Regular && bytes >= huge_page_size; }
+
+    /** Maps @p bytes of memory at an address aligned to a huge page, and marks it as eligible for huge pages. */
+    static void *map_aligned(size_t bytes) {
+        auto mapped_bytes = bytes + huge_page_size;
+        auto p = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            throw std::bad_alloc();
+
+        auto begin = reinterpret_cast<uintptr_t>(p);
+        auto aligned_begin = (begin + huge_page_size - 1) / huge_page_size * huge_page_size;
+        if (aligned_begin != begin)
+            munmap(p, aligned_begin - begin);
+        if (aligned_begin + bytes != begin + mapped_bytes)
+            munmap(reinterpret_cast<void *>(aligned_begin + bytes), begin + mapped_bytes - aligned_begin - bytes);
+
+        p = reinterpret_cast<void *>(aligned_begin);
+#ifdef MADV_HUGEPAGE
+        madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+        return p;
+    }
+#endif
+
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    static constexpr size_t cache_line_size = 64;
+    static constexpr size_t huge_page_size = 2 << 20;
+
+    /**
+     * Constructs an allocator with the given page policy.
+     * @param policy the kind of pages that back the allocated blocks
+     */
+    AlignedAllocator(PagePolicy policy = PagePolicy::Regular) noexcept : policy(policy) {}
+
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U> &other) noexcept : policy(other.policy) {}
+
+    /**
+     * Returns the page policy of this allocator.
+     * @return the page policy of this allocator
+     */
+    PagePolicy page_policy() const { return policy; }
+
+    T *allocate(size_t n) {
+        auto bytes = n * sizeof(T);
+#if defined(__unix__) || defined(__APPLE__)
+        if (uses_huge_pages(bytes)) {
+            auto rounded_bytes = round_to_huge_page(bytes);
+            void *p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+            if (policy == PagePolicy::HugePages)
+                p = mmap(nullptr, rounded_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                         -1, 0);
+#endif
+            if (p == MAP_FAILED)
+                p = map_aligned(rounded_bytes);
+            return static_cast<T *>(p);
+        }
+#endif
+        return static_cast<T *>(::operator new(bytes, std::align_val_t(cache_line_size)));
+    }
+
+    void deallocate(T *p, [[maybe_unused]] size_t n) noexcept {
+#if defined(__unix__) || defined(__APPLE__)
+        auto bytes = n * sizeof(T);
+        if (uses_huge_pages(bytes)) {
+            munmap(p, round_to_huge_page(bytes));
+            return;
+        }
+#endif
+        ::operator delete(p, std::align_val_t(cache_line_size));
+    }
+
+    template<typename U>
+    bool operator==(const AlignedAllocator<U> &other) const { return policy == other.policy; }
+
+    template<typename U>
+    bool operator!=(const AlignedAllocator<U> &other) const { return policy != other.policy; }
+};
+
+}
@@ -0,0 +1,149 @@
+// This file is part of PGM-index <https://github.com/gvinciguerra/PGM-index>.
+// Copyright (c) 2018 Giorgio Vinciguerra.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace pgm {
+
+/**
+ * Maps keys of type @p K to an unsigned integral type, so that they can be indexed by a @ref PGMIndex.
+ *
+ * A specialization defines the type @c encoded_type, the function @c encode, which must be monotone (i.e. a < b
+ * implies encode(a) <= encode(b)), and the constant @c is_exact, which is @c true if @c encode is also injective.
+ */
+template<typename K, typename = void>
+struct KeyTraits;
+
+/** Integral keys are indexed as they are. */
+template<typename K>
+struct KeyTraits<K, std::enable_if_t<std::is_integral_v<K>>> {
+    using encoded_type = K;
+    static constexpr bool is_exact = true;
+
+    static encoded_type encode(const K &key) { return key; }
+};
+
+/**
+ * Floating-point keys are mapped to the unsigned integers with the same bits, after flipping the sign bit of the
+ * positive numbers and all the bits of the negative ones, which preserves the order. NaNs are not supported.
+ */
+template<typename K>
+struct KeyTraits<K, std::enable_if_t<std::is_floating_point_v<K>>> {
+    static_assert(sizeof(K) == 4 || sizeof(K) == 8, "Unsupported floating-point type");
+    using encoded_type = std::conditional_t<sizeof(K) == 4, uint32_t, uint64_t>;
+    static constexpr bool is_exact = true;
+
+    static encoded_type encode(K key) {
+        constexpr auto sign_bit = encoded_type(1) << (sizeof(K) * 8 - 1);
+        encoded_type bits;
+        key = key == 0 ? K(0) : key; // -0.0 and +0.0 compare equal, so they must be mapped to the same value
+        std::memcpy(&bits, &key, sizeof(K));
+        return bits & sign_bit ? ~bits : bits | sign_bit;
+    }
+};
+
+/**
+ * Maps strings to the big-endian integer formed by their first sizeof(@p Encoded) bytes, padded with zeros. Distinct
+ * strings may share a prefix, thus a search on the prefixes must be refined by comparing the strings.
+ *
+ * @tparam Encoded the unsigned integral type storing the prefix, e.g. @c uint64_t or @c unsigned @c __int128
+ */
+template<typename Encoded = uint64_t>
+struct StringPrefixTraits {
+    static_assert(std::is_integral_v<Encoded> && std::is_unsigned_v<Encoded>);
+    using encoded_type = Encoded;
+    static constexpr bool is_exact = false;
+
+    static encoded_type encode(std::string_view key) {
+        encoded_type prefix = 0;
+        for (size_t i = 0; i < sizeof(Encoded); ++i)
+            prefix = (prefix << 8) | (i < key.size() ? (unsigned char) key[i] : 0u);
+        return prefix;
+    }
+};
+
+template<>
+struct KeyTraits<std::string> : StringPrefixTraits<uint64_t> {};
+
+template<>
+struct KeyTraits<std::string_view> : StringPrefixTraits<uint64_t> {};
+
+namespace internal {
+
+/** A random-access iterator that returns the encoding, according to @p Traits, of the keys pointed by @p RandomIt. */
+template<typename RandomIt, typename Traits>
+class EncodingIterator {
+    RandomIt it;
+
+public:
+    using value_type = typename Traits::encoded_type;
+    using difference_type = typename std::iterator_traits<RandomIt>::difference_type;
+    using reference = value_type;
+    using pointer = void;
+    using iterator_category = std::random_access_iterator_tag;
+
+    EncodingIterator() = default;
+
+    explicit EncodingIterator(RandomIt it) : it(it) {}
+
+    value_type operator*() const { return Traits::encode(*it); }
+    value_type operator[](difference_type i) const { return Traits::encode(it[i]); }
+
+    EncodingIterator &operator++() {
+        ++it;
+        return *this;
+    }
+
+    EncodingIterator &operator--() {
+        --it;
+        return *this;
+    }
+
+    EncodingIterator operator++(int) { return EncodingIterator(it++); }
+    EncodingIterator operator--(int) { return EncodingIterator(it--); }
+
+    EncodingIterator &operator+=(difference_type n) {
+        it += n;
+        return *this;
+    }
+
+    EncodingIterator &operator-=(difference_type n) {
+        it -= n;
+        return *this;
+    }
+
+    EncodingIterator operator+(difference_type n) const { return EncodingIterator(it + n); }
+    EncodingIterator operator-(difference_type n) const { return EncodingIterator(it - n); }
+    difference_type operator-(const EncodingIterator &other) const { return it - other.it; }
+
+    bool operator==(const EncodingIterator &other) const { return it == other.it; }
+    bool operator!=(const EncodingIterator &other) const { return it != other.it; }
+    bool operator<(const EncodingIterator &other) const { return it < other.it; }
+    bool operator>(const EncodingIterator &other) const { return it > other.it; }
+    bool operator<=(const EncodingIterator &other) const { return it <= other.it; }
+    bool operator>=(const EncodingIterator &other) const { return it >= other.it; }
+};
+
+}
+
+}
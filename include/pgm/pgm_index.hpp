@@ -15,13 +15,18 @@
 
 #pragma once
 
+#include "allocator.hpp"
 #include "piecewise_linear_model.hpp"
+#include "simd_search.hpp"
 #include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <iterator>
 #include <limits>
+#include <ostream>
 #include <stdexcept>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -30,6 +35,163 @@ namespace pgm {
 #define PGM_SUB_EPS(x, epsilon) ((x) <= (epsilon) ? 0 : ((x) - (epsilon)))
 #define PGM_ADD_EPS(x, epsilon, size) ((x) + (epsilon) + 2 >= (size) ? (size) : (x) + (epsilon) + 2)
 
+namespace internal {
+
+/**
+ * Returns an iterator to the first element in the small sorted range [first, last) that is not less than @p key, by
+ * counting the elements less than @p key without data-dependent branches.
+ */
+template<typename RandomIt, typename K>
+RandomIt linear_lower_bound(RandomIt first, RandomIt last, const K &key) {
+    size_t count = 0;
+    for (auto it = first; it != last; ++it)
+        count += *it < key;
+    return first + count;
+}
+
+/**
+ * Returns an iterator to the first element in the sorted range [first, last) that is not less than @p key, using a
+ * binary search whose loop body is branchless and prefetches both of the next candidate positions.
+ */
+template<typename RandomIt, typename K>
+RandomIt branchless_lower_bound(RandomIt first, RandomIt last, const K &key) {
+    auto n = std::distance(first, last);
+    if (n == 0)
+        return first;
+    while (n > 1) {
+        auto half = n / 2;
+        __builtin_prefetch(&*(first + half / 2), 0, 0);
+        __builtin_prefetch(&*(first + half + half / 2), 0, 0);
+        first = first[half] < key ? first + half : first;
+        n -= half;
+    }
+    return first + (*first < key);
+}
+
+/**
+ * Returns an iterator to the first element in the sorted range [first, last) that is greater than @p key, given that
+ * all the elements before @p first are not greater than @p key. The search gallops forward from @p first, so it costs
+ * time logarithmic in the distance from @p first to the result.
+ */
+template<typename RandomIt, typename K>
+RandomIt exponential_upper_bound(RandomIt first, RandomIt last, const K &key) {
+    if (first == last || key < *first)
+        return first;
+    size_t step = 1;
+    while (step < size_t(std::distance(first, last)) && !(key < first[step]))
+        step *= 2;
+    auto hi = step < size_t(std::distance(first, last)) ? first + step : last;
+    return std::upper_bound(first + step / 2, hi, key);
+}
+
+/** Checks if the elements referred by @p RandomIt are stored contiguously in memory. */
+template<typename RandomIt, typename T = typename std::iterator_traits<RandomIt>::value_type>
+constexpr bool is_contiguous_iterator = std::is_pointer_v<RandomIt>
+                                        || std::is_same_v<RandomIt, typename std::vector<T>::iterator>
+                                        || std::is_same_v<RandomIt, typename std::vector<T>::const_iterator>;
+
+/**
+ * Returns an iterator to the first element in the sorted range [first, last) that is not less than @p key. The range
+ * is halved with branchless steps until it spans at most 16 cache lines, whose elements less than @p key are then
+ * counted with SIMD instructions.
+ */
+template<typename RandomIt, typename K>
+RandomIt simd_lower_bound(RandomIt first, RandomIt last, const K &key) {
+    static constexpr size_t simd_search_threshold = 1024 / sizeof(K);
+    size_t n = std::distance(first, last);
+    while (n > simd_search_threshold) {
+        auto half = n / 2;
+        __builtin_prefetch(&*(first + half / 2), 0, 0);
+        __builtin_prefetch(&*(first + half + half / 2), 0, 0);
+        first = first[half] < key ? first + half : first;
+        n -= half;
+    }
+    return n == 0 ? first : first + simd_rank<false>(&*first, n, key);
+}
+
+/**
+ * Returns an iterator to the first element in the sorted range [first, last) that is not less than @p key. The search
+ * gallops forward from @p first, so it costs time logarithmic in the distance from @p first to the result.
+ */
+template<typename RandomIt, typename K>
+RandomIt exponential_lower_bound(RandomIt first, RandomIt last, const K &key) {
+    if (first == last || !(*first < key))
+        return first;
+    size_t step = 1;
+    while (step < size_t(std::distance(first, last)) && first[step] < key)
+        step *= 2;
+    auto hi = step < size_t(std::distance(first, last)) ? first + step : last;
+    return std::lower_bound(first + step / 2, hi, key);
+}
+
+/**
+ * Returns an iterator to the first element in the range [lo, hi) returned by a search with the given @p Epsilon that is
+ * not less than @p key, choosing the search kernel that suits the size of the range and the layout of the data.
+ */
+template<size_t Epsilon, typename RandomIt, typename K>
+RandomIt lower_bound_in_range(RandomIt lo, RandomIt hi, const K &key) {
+    using value_type = typename std::iterator_traits<RandomIt>::value_type;
+    static constexpr size_t linear_search_threshold = 32;
+    if constexpr (is_contiguous_iterator<RandomIt> && simd_rank_supported<value_type> && std::is_same_v<K, value_type>)
+        return simd_lower_bound(lo, hi, key);
+    else if constexpr (Epsilon <= linear_search_threshold)
+        return linear_lower_bound(lo, hi, key);
+    else
+        return branchless_lower_bound(lo, hi, key);
+}
+
+/**
+ * The header of the on-disk format of a @ref PGMIndex, written by @ref PGMIndex::save and read in place by
+ * @ref PGMIndexView. It is followed by the array of levels offsets and the array of segments, each starting at a
+ * multiple of @ref alignment bytes from the beginning of the file.
+ */
+struct SerializedHeader {
+    static constexpr char expected_magic[8] = {'P', 'G', 'M', '-', 'I', 'D', 'X', '\0'};
+    static constexpr uint32_t current_version = 1;
+    static constexpr uint32_t byte_order_mark = 0x01020304;
+    static constexpr size_t alignment = 64;
+
+    char magic[8];                    ///< The string "PGM-IDX".
+    uint32_t version;                 ///< The version of the format.
+    uint32_t byte_order;              ///< The value @ref byte_order_mark, written with the endianness of the writer.
+    uint32_t key_size;                ///< The size of the key type.
+    uint32_t key_flags;               ///< Bit 0 is set if the key type is signed, bit 1 if it is floating-point.
+    uint32_t floating_size;           ///< The size of the floating-point type of the slopes.
+    uint32_t intercept_size;          ///< The size of the integer type of the intercepts.
+    uint32_t segment_size;            ///< The size of a segment.
+    uint32_t offset_size;             ///< The size of an entry of the levels offsets.
+    uint64_t epsilon;                 ///< The value of Epsilon.
+    uint64_t epsilon_recursive;       ///< The value of EpsilonRecursive.
+    uint64_t n;                       ///< The number of elements the index was built on.
+    uint64_t levels_offsets_count;    ///< The number of entries of the levels offsets.
+    uint64_t segments_count;          ///< The number of segments, including the sentinels.
+    uint64_t levels_offsets_position; ///< The position in bytes of the levels offsets from the start of the file.
+    uint64_t segments_position;       ///< The position in bytes of the segments from the start of the file.
+    unsigned char first_key[16];      ///< The bytes of the smallest element.
+
+    template<typename K, typename Floating, typename Intercept, typename Segment>
+    static SerializedHeader make(size_t epsilon, size_t epsilon_recursive) {
+        static_assert(sizeof(K) <= sizeof(first_key) && std::is_trivially_copyable_v<K>);
+        SerializedHeader h{};
+        std::memcpy(h.magic, expected_magic, sizeof(magic));
+        h.version = current_version;
+        h.byte_order = byte_order_mark;
+        h.key_size = sizeof(K);
+        h.key_flags = (std::is_signed_v<K> ? 1 : 0) | (std::is_floating_point_v<K> ? 2 : 0);
+        h.floating_size = sizeof(Floating);
+        h.intercept_size = sizeof(Intercept);
+        h.segment_size = sizeof(Segment);
+        h.offset_size = sizeof(size_t);
+        h.epsilon = epsilon;
+        h.epsilon_recursive = epsilon_recursive;
+        return h;
+    }
+
+    static size_t align(size_t bytes) { return (bytes + alignment - 1) / alignment * alignment; }
+};
+
+}
+
 /**
  * A struct that stores the result of a query to a @ref PGMIndex, that is, a range [@ref lo, @ref hi)
  * centered around an approximate position @ref pos of the sought key.
@@ -60,8 +222,10 @@ struct ApproxPos {
  * @tparam Epsilon controls the size of the returned search range
  * @tparam EpsilonRecursive controls the size of the search range in the internal structure
  * @tparam Floating the floating-point type to use for slopes
+ * @tparam Intercept the signed integer type to use for intercepts, which must be able to store the number of keys
  */
-template<typename K, size_t Epsilon = 64, size_t EpsilonRecursive = 4, typename Floating = float>
+template<typename K, size_t Epsilon = 64, size_t EpsilonRecursive = 4, typename Floating = float,
+         typename Intercept = int32_t>
 class PGMIndex {
 protected:
     template<typename, size_t, size_t, uint8_t, typename>
@@ -70,18 +234,38 @@ protected:
     template<typename, size_t, typename>
     friend class EliasFanoPGMIndex;
 
+    template<typename, size_t, size_t, typename>
+    friend class SoAPGMIndex;
+
+    template<typename, size_t, typename>
+    friend class BTreePGMIndex;
+
+    template<typename, size_t, size_t, typename, size_t, typename>
+    friend class FixedHeightPGMIndex;
+
+    template<typename, size_t, size_t, typename, typename>
+    friend class PGMIndexView;
+
+    template<typename, size_t, size_t, typename, typename>
+    friend class PGMIndexBuilder;
+
+    template<typename, size_t, typename, typename>
+    friend class RuntimePGMIndex;
+
     static_assert(Epsilon > 0);
     struct Segment;
 
-    size_t n;                           ///< The number of elements this index was built on.
-    K first_key;                        ///< The smallest element.
-    std::vector<Segment> segments;      ///< The segments composing the index.
+    static constexpr size_t batch_group_size = 16;
+
+    size_t n;                                                 ///< The number of elements this index was built on.
+    K first_key;                                              ///< The smallest element.
+    std::vector<Segment, AlignedAllocator<Segment>> segments; ///< The segments composing the index.
     std::vector<size_t> levels_offsets; ///< The starting position of each level in segments[], in reverse order.
 
-    template<typename RandomIt>
+    template<typename RandomIt, typename Segments>
     static void build(RandomIt first, RandomIt last,
                       size_t epsilon, size_t epsilon_recursive,
-                      std::vector<Segment> &segments,
+                      Segments &segments,
                       std::vector<size_t> &levels_offsets) {
         auto n = (size_t) std::distance(first, last);
         if (n == 0)
@@ -94,51 +278,77 @@ protected:
         auto last_n = n - ignore_last;
         last -= ignore_last;
 
-        auto build_level = [&](auto epsilon, auto in_fun, auto out_fun) {
-            auto n_segments = internal::make_segmentation_par(last_n, epsilon, in_fun, out_fun);
-            if (segments.back().slope == 0 && last_n > 1) {
-                // Here we need to ensure that keys > *(last-1) are approximated to a position == prev_level_size
-                segments.emplace_back(*std::prev(last) + 1, 0, last_n);
-                ++n_segments;
-            }
-            segments.emplace_back(last_n); // Add the sentinel segment
-            return n_segments;
-        };
-
         // Build first level
-        auto in_fun = [&](auto i) {
+        auto in_fun = first_level_points(first, n);
+        auto out_fun = [&](auto cs) { segments.emplace_back(cs); };
+        auto n_segments = internal::make_segmentation_par(last_n, epsilon, in_fun, out_fun);
+        build_upper_levels(last_n, n_segments, *std::prev(last), epsilon_recursive, segments, levels_offsets);
+    }
+
+    /**
+     * Returns the function mapping i to the point (key, rank) of the first level for the i-th of the @p n sorted keys
+     * starting at @p first.
+     */
+    template<typename RandomIt>
+    static auto first_level_points(RandomIt first, size_t n) {
+        return [first, n](auto i) mutable {
             auto x = first[i];
             // Here there is an adjustment for inputs with duplicate keys: at the end of a run of duplicate keys equal
             // to x=first[i] such that x+1!=first[i+1], we map the values x+1,...,first[i+1]-1 to their correct rank i
             auto flag = i > 0 && i + 1u < n && x == first[i - 1] && x != first[i + 1] && x + 1 != first[i + 1];
             return std::pair<K, size_t>(x + flag, i);
         };
-        auto out_fun = [&](auto cs) { segments.emplace_back(cs); };
-        last_n = build_level(epsilon, in_fun, out_fun);
-        levels_offsets.push_back(levels_offsets.back() + last_n + 1);
+    }
 
-        // Build upper levels
+    /**
+     * Completes the first level, whose segments are the only ones in @p segments, and builds the upper levels on it.
+     * @param last_n the number of keys indexed by the first level, excluding the max() sentinel
+     * @param n_segments the number of segments in the first level
+     * @param last_key the largest key indexed by the first level
+     * @param epsilon_recursive the maximum error of the upper levels
+     * @param segments the segments of the first level, to which the segments of the upper levels are appended
+     * @param levels_offsets the vector {0}, to which the starting position of each level is appended
+     */
+    template<typename Segments>
+    static void build_upper_levels(size_t last_n, size_t n_segments, const K &last_key, size_t epsilon_recursive,
+                                   Segments &segments, std::vector<size_t> &levels_offsets) {
+        auto close_level = [&](size_t n_segments) {
+            if (segments.back().slope == 0 && last_n > 1) {
+                // Here we need to ensure that keys > last_key are approximated to a position == prev_level_size
+                segments.emplace_back(last_key + 1, 0, last_n);
+                ++n_segments;
+            }
+            segments.emplace_back(last_n); // Add the sentinel segment
+            levels_offsets.push_back(levels_offsets.back() + n_segments + 1);
+            return n_segments;
+        };
+        last_n = close_level(n_segments);
+
+        auto out_fun = [&](auto cs) { segments.emplace_back(cs); };
         while (epsilon_recursive && last_n > 1) {
             auto offset = levels_offsets[levels_offsets.size() - 2];
             auto in_fun_rec = [&](auto i) { return std::pair<K, size_t>(segments[offset + i].key, i); };
-            last_n = build_level(epsilon_recursive, in_fun_rec, out_fun);
-            levels_offsets.push_back(levels_offsets.back() + last_n + 1);
+            last_n = close_level(internal::make_segmentation_par(last_n, epsilon_recursive, in_fun_rec, out_fun));
         }
     }
 
     /**
      * Returns the segment responsible for a given key, that is, the rightmost segment having key <= the sought key.
+     * @param segments the segments of the index
+     * @param levels_offsets the starting position of each level in segments[]
+     * @param height the number of levels of the index
      * @param key the value of the element to search for
-     * @return an iterator to the segment responsible for the given key
+     * @return a pointer to the segment responsible for the given key
      */
-    auto segment_for_key(const K &key) const {
+    static const Segment *segment_for_key(const Segment *segments, const size_t *levels_offsets, size_t height,
+                                          const K &key) {
         if constexpr (EpsilonRecursive == 0) {
-            return std::prev(std::upper_bound(segments.begin(), segments.begin() + segments_count(), key));
+            return std::prev(std::upper_bound(segments, segments + levels_offsets[1] - 1, key));
         }
 
-        auto it = segments.begin() + *(levels_offsets.end() - 2);
-        for (auto l = int(height()) - 2; l >= 0; --l) {
-            auto level_begin = segments.begin() + levels_offsets[l];
+        auto it = segments + levels_offsets[height - 1];
+        for (auto l = int(height) - 2; l >= 0; --l) {
+            auto level_begin = segments + levels_offsets[l];
             auto pos = std::min<size_t>((*it)(key), std::next(it)->intercept);
             auto lo = level_begin + PGM_SUB_EPS(pos, EpsilonRecursive + 1);
 
@@ -156,6 +366,15 @@ protected:
         return it;
     }
 
+    /**
+     * Returns the segment responsible for a given key, that is, the rightmost segment having key <= the sought key.
+     * @param key the value of the element to search for
+     * @return a pointer to the segment responsible for the given key
+     */
+    auto segment_for_key(const K &key) const {
+        return segment_for_key(segments.data(), levels_offsets.data(), height(), key);
+    }
+
 public:
 
     static constexpr size_t epsilon_value = Epsilon;
@@ -168,22 +387,125 @@ public:
     /**
      * Constructs the index on the given sorted vector.
      * @param data the vector of keys to be indexed, must be sorted
+     * @param policy the kind of memory pages that back the segments of the index
      */
-    explicit PGMIndex(const std::vector<K> &data) : PGMIndex(data.begin(), data.end()) {}
+    explicit PGMIndex(const std::vector<K> &data, PagePolicy policy = PagePolicy::Regular)
+        : PGMIndex(data.begin(), data.end(), policy) {}
 
     /**
      * Constructs the index on the sorted keys in the range [first, last).
      * @param first, last the range containing the sorted keys to be indexed
+     * @param policy the kind of memory pages that back the segments of the index
      */
     template<typename RandomIt>
-    PGMIndex(RandomIt first, RandomIt last)
+    PGMIndex(RandomIt first, RandomIt last, PagePolicy policy = PagePolicy::Regular)
         : n(std::distance(first, last)),
           first_key(n ? *first : K(0)),
-          segments(),
+          segments(AlignedAllocator<Segment>(policy)),
           levels_offsets() {
         build(first, last, Epsilon, EpsilonRecursive, segments, levels_offsets);
     }
 
+    /**
+     * Builds an index on the sorted keys in [first, last), which differ from the sorted keys in [old_first, old_last)
+     * on which @p old_index was built only by keys inserted or removed within @p changed_ranges.
+     *
+     * A segment of the last level of @p old_index is copied, with its intercept shifted by the difference between the
+     * new and the old rank of its first key, if no changed range intersects the keys from its first key to the first
+     * key of the next segment. The keys between the copied segments are segmented again, and the upper levels are
+     * built from scratch. Thus, the cost is proportional to the number of keys in the segments that changed, plus two
+     * binary searches for each copied segment.
+     *
+     * @param old_index the index built on the keys in [old_first, old_last)
+     * @param old_first, old_last the range containing the sorted keys on which @p old_index was built
+     * @param first, last the range containing the new sorted keys to be indexed
+     * @param changed_ranges the closed ranges of keys [lo, hi] containing every inserted or removed key
+     * @return the index on the new keys, with the page policy of @p old_index
+     */
+    template<typename OldRandomIt, typename RandomIt>
+    static PGMIndex rebuild(const PGMIndex &old_index, OldRandomIt old_first, OldRandomIt old_last,
+                            RandomIt first, RandomIt last, std::vector<std::pair<K, K>> changed_ranges) {
+        PGMIndex index;
+        index.n = std::distance(first, last);
+        index.first_key = index.n ? *first : K(0);
+        index.segments = decltype(segments)(old_index.segments.get_allocator());
+        index.levels_offsets = {};
+
+        auto n = index.n;
+        auto last_n = n - (n && *std::prev(last) == std::numeric_limits<K>::max());
+        if (old_index.segments.empty() || last_n == 0) {
+            build(first, last, Epsilon, EpsilonRecursive, index.segments, index.levels_offsets);
+            return index;
+        }
+
+        // Merge the overlapping ranges, so that both their endpoints are increasing
+        std::sort(changed_ranges.begin(), changed_ranges.end());
+        size_t ranges = 0;
+        for (auto &r : changed_ranges) {
+            if (ranges > 0 && r.first <= changed_ranges[ranges - 1].second)
+                changed_ranges[ranges - 1].second = std::max(changed_ranges[ranges - 1].second, r.second);
+            else
+                changed_ranges[ranges++] = r;
+        }
+        changed_ranges.resize(ranges);
+        auto range_it = changed_ranges.begin();
+        auto is_unchanged = [&](const K &lo, const K &hi) {
+            while (range_it != changed_ranges.end() && range_it->second < lo)
+                ++range_it;
+            return range_it == changed_ranges.end() || hi < range_it->first;
+        };
+
+        auto in_fun = first_level_points(first, n);
+        auto out_fun = [&](const auto &cs, size_t, size_t) {
+            index.segments.emplace_back(cs);
+            return true;
+        };
+
+        index.levels_offsets.push_back(0);
+        auto old_m = old_index.segments_count();
+        size_t n_segments = 0;
+        size_t next_rank = 0; // The rank of the first key not yet indexed by a segment
+        for (size_t i = 0; i < old_m; ++i) {
+            auto &s = old_index.segments[i];
+            auto is_last = i + 1 == old_m;
+            auto next_key = is_last ? std::numeric_limits<K>::max() : old_index.segments[i + 1].key;
+            if (!is_unchanged(s.key, next_key))
+                continue;
+
+            // The segment keys may be shifted by the adjustment for duplicates, so they are looked up in the new keys
+            auto rank = size_t(std::lower_bound(first + next_rank, first + last_n, s.key) - first);
+            auto end_rank = is_last ? last_n : size_t(std::lower_bound(first + rank, first + last_n, next_key) - first);
+            auto end_found = is_last || (end_rank < last_n && first[end_rank] == next_key);
+            if (rank == last_n || first[rank] != s.key || !end_found)
+                continue;
+
+            auto old_rank = std::lower_bound(old_first, old_last, s.key) - old_first;
+            auto intercept = int64_t(s.intercept) + int64_t(rank) - int64_t(old_rank);
+            if (intercept > std::numeric_limits<Intercept>::max())
+                throw std::overflow_error("Change the Intercept type of PGMIndex to int64_t");
+
+            n_segments += internal::make_segmentation_from(next_rank, rank, Epsilon, in_fun, out_fun);
+            index.segments.emplace_back(s.key, s.slope, Intercept(intercept));
+            ++n_segments;
+            next_rank = end_rank;
+        }
+        n_segments += internal::make_segmentation_from(next_rank, last_n, Epsilon, in_fun, out_fun);
+
+        build_upper_levels(last_n, n_segments, first[last_n - 1], EpsilonRecursive, index.segments,
+                           index.levels_offsets);
+        return index;
+    }
+
+    /**
+     * Returns the result of @ref rebuild on the begin and end of the random-access ranges @p old_data and @p data.
+     */
+    template<typename OldRange, typename Range>
+    static PGMIndex rebuild(const PGMIndex &old_index, const OldRange &old_data, const Range &data,
+                            std::vector<std::pair<K, K>> changed_ranges) {
+        return rebuild(old_index, std::begin(old_data), std::end(old_data), std::begin(data), std::end(data),
+                       std::move(changed_ranges));
+    }
+
     /**
      * Returns the approximate position and the range where @p key can be found.
      * @param key the value of the element to search for
@@ -198,6 +520,194 @@ public:
         return {pos, lo, hi};
     }
 
+    /**
+     * Returns an iterator pointing to the first element in the range [first, last) that is not less than (i.e. greater
+     * or equal to) @p key.
+     * @param first, last the range containing the sorted keys on which the index was built
+     * @param key value to compare the elements to
+     * @return iterator to the first element that is not less than @p key, or @p last if no such element is found
+     */
+    template<typename RandomIt>
+    RandomIt lower_bound(RandomIt first, [[maybe_unused]] RandomIt last, const K &key) const {
+        auto range = search(key);
+        return internal::lower_bound_in_range<Epsilon>(first + range.lo, first + range.hi, key);
+    }
+
+    /**
+     * Returns an iterator pointing to the first element in the range [first, last) that is greater than @p key.
+     * @param first, last the range containing the sorted keys on which the index was built
+     * @param key value to compare the elements to
+     * @return iterator to the first element that is greater than @p key, or @p last if no such element is found
+     */
+    template<typename RandomIt>
+    RandomIt upper_bound(RandomIt first, RandomIt last, const K &key) const {
+        return internal::exponential_upper_bound(lower_bound(first, last, key), last, key);
+    }
+
+    /**
+     * Returns an iterator pointing to the first element in the range [first, last) that is equal to @p key.
+     * @param first, last the range containing the sorted keys on which the index was built
+     * @param key value of the element to search for
+     * @return iterator to an element equal to @p key, or @p last if no such element is found
+     */
+    template<typename RandomIt>
+    RandomIt find(RandomIt first, RandomIt last, const K &key) const {
+        auto it = lower_bound(first, last, key);
+        return it != last && *it == key ? it : last;
+    }
+
+    /**
+     * Returns the range of the elements in [first, last) that are equal to @p key.
+     * @param first, last the range containing the sorted keys on which the index was built
+     * @param key value to compare the elements to
+     * @return a pair of iterators delimiting the elements equal to @p key
+     */
+    template<typename RandomIt>
+    std::pair<RandomIt, RandomIt> equal_range(RandomIt first, RandomIt last, const K &key) const {
+        auto lb = lower_bound(first, last, key);
+        return {lb, internal::exponential_upper_bound(lb, last, key)};
+    }
+
+    /**
+     * Checks if there is an element equal to @p key in the range [first, last).
+     * @param first, last the range containing the sorted keys on which the index was built
+     * @param key value of the element to search for
+     * @return @c true if there is such an element, otherwise @c false
+     */
+    template<typename RandomIt>
+    bool contains(RandomIt first, RandomIt last, const K &key) const { return find(first, last, key) != last; }
+
+    /**
+     * Returns the result of @c lower_bound(first, last, key) on the begin and end of the random-access range @p data.
+     */
+    template<typename Range>
+    auto lower_bound(const Range &data, const K &key) const {
+        return lower_bound(std::begin(data), std::end(data), key);
+    }
+
+    /**
+     * Returns the result of @c upper_bound(first, last, key) on the begin and end of the random-access range @p data.
+     */
+    template<typename Range>
+    auto upper_bound(const Range &data, const K &key) const {
+        return upper_bound(std::begin(data), std::end(data), key);
+    }
+
+    /**
+     * Returns the result of @c find(first, last, key) on the begin and end of the random-access range @p data.
+     */
+    template<typename Range>
+    auto find(const Range &data, const K &key) const { return find(std::begin(data), std::end(data), key); }
+
+    /**
+     * Returns the result of @c equal_range(first, last, key) on the begin and end of the random-access range @p data.
+     */
+    template<typename Range>
+    auto equal_range(const Range &data, const K &key) const {
+        return equal_range(std::begin(data), std::end(data), key);
+    }
+
+    /**
+     * Returns the result of @c contains(first, last, key) on the begin and end of the random-access range @p data.
+     */
+    template<typename Range>
+    bool contains(const Range &data, const K &key) const { return contains(std::begin(data), std::end(data), key); }
+
+    /**
+     * Returns the approximate positions and the ranges where the given keys can be found.
+     *
+     * The keys are processed in groups that descend the levels of the index together. Before scanning a level, the
+     * segments that each key of the group will visit are prefetched, so that their cache misses overlap rather than
+     * being paid one key at a time as in a loop of @ref search calls.
+     *
+     * @param keys the values of the elements to search for
+     * @param count the number of keys
+     * @param out an array of at least @p count elements where the results are stored, in the order of @p keys
+     */
+    void search_batch(const K *keys, size_t count, ApproxPos *out) const {
+        K k[batch_group_size];
+        size_t s[batch_group_size];
+
+        for (size_t i = 0; i < count; i += batch_group_size) {
+            auto m = std::min(batch_group_size, count - i);
+            for (size_t j = 0; j < m; ++j)
+                k[j] = std::max(first_key, keys[i + j]);
+
+            if constexpr (EpsilonRecursive == 0) {
+                // Interleaved branchless binary search for the rightmost segment having key <= k[j]
+                std::fill_n(s, m, 0);
+                for (auto len = segments_count(); len > 1; len -= len / 2) {
+                    auto half = len / 2;
+                    for (size_t j = 0; j < m; ++j) {
+                        __builtin_prefetch(&segments[s[j] + half / 2], 0, 0);
+                        __builtin_prefetch(&segments[s[j] + half + half / 2], 0, 0);
+                    }
+                    for (size_t j = 0; j < m; ++j)
+                        s[j] = segments[s[j] + half].key <= k[j] ? s[j] + half : s[j];
+                }
+            } else {
+                std::fill_n(s, m, *(levels_offsets.end() - 2));
+                for (auto l = int(height()) - 2; l >= 0; --l) {
+                    auto level_begin = levels_offsets[l];
+                    auto level_size = levels_offsets[l + 1] - levels_offsets[l] - 1;
+                    size_t pos[batch_group_size];
+
+                    for (size_t j = 0; j < m; ++j) {
+                        pos[j] = std::min<size_t>(segments[s[j]](k[j]), segments[s[j] + 1].intercept);
+                        s[j] = level_begin + PGM_SUB_EPS(pos[j], EpsilonRecursive + 1);
+                        __builtin_prefetch(&segments[s[j]], 0, 0);
+                        __builtin_prefetch(&segments[level_begin + pos[j]], 0, 0);
+                    }
+
+                    static constexpr size_t linear_search_threshold = 8 * 64 / sizeof(Segment);
+                    for (size_t j = 0; j < m; ++j) {
+                        if constexpr (EpsilonRecursive <= linear_search_threshold) {
+                            while (segments[s[j] + 1].key <= k[j])
+                                ++s[j];
+                        } else {
+                            auto lo = segments.begin() + s[j];
+                            auto hi = segments.begin() + level_begin;
+                            hi += PGM_ADD_EPS(pos[j], EpsilonRecursive, level_size);
+                            s[j] = std::distance(segments.begin(), std::upper_bound(lo, hi, k[j])) - 1;
+                        }
+                    }
+                }
+            }
+
+            for (size_t j = 0; j < m; ++j) {
+                auto pos = std::min<size_t>(segments[s[j]](k[j]), segments[s[j] + 1].intercept);
+                out[i + j] = {pos, PGM_SUB_EPS(pos, Epsilon), PGM_ADD_EPS(pos, Epsilon, n)};
+            }
+        }
+    }
+
+    /**
+     * Writes the index to the given stream in a format that @ref PGMIndexView can search in place, without parsing or
+     * copying it. The format depends on the endianness of the CPU and on the template arguments of the index.
+     * @param out the output stream, which should be opened in binary mode
+     */
+    void save(std::ostream &out) const {
+        auto header = internal::SerializedHeader::make<K, Floating, Intercept, Segment>(Epsilon, EpsilonRecursive);
+        header.n = n;
+        header.levels_offsets_count = levels_offsets.size();
+        header.segments_count = segments.size();
+        header.levels_offsets_position = internal::SerializedHeader::align(sizeof(header));
+        header.segments_position = internal::SerializedHeader::align(header.levels_offsets_position
+                                                                     + levels_offsets.size() * sizeof(size_t));
+        std::memcpy(header.first_key, &first_key, sizeof(K));
+
+        static const char padding[internal::SerializedHeader::alignment] = {};
+        auto pad_to = [&](size_t position, size_t written) { out.write(padding, position - written); };
+        auto levels_offsets_bytes = levels_offsets.size() * sizeof(size_t);
+        out.write((const char *) &header, sizeof(header));
+        pad_to(header.levels_offsets_position, sizeof(header));
+        out.write((const char *) levels_offsets.data(), levels_offsets_bytes);
+        pad_to(header.segments_position, header.levels_offsets_position + levels_offsets_bytes);
+        out.write((const char *) segments.data(), segments.size() * sizeof(Segment));
+        if (!out)
+            throw std::runtime_error("Error while writing the index");
+    }
+
     /**
      * Returns the number of segments in the last level of the index.
      * @return the number of segments
@@ -217,25 +727,153 @@ public:
     size_t size_in_bytes() const { return segments.size() * sizeof(Segment) + levels_offsets.size() * sizeof(size_t); }
 };
 
+/**
+ * Builds a @ref PGMIndex on a sequence of sorted keys that are pushed one at a time, without storing them.
+ *
+ * The segments of the first level are emitted as soon as the keys no longer fit them, and the upper levels are built
+ * by @ref finish. Thus, the memory used is proportional to the number of segments rather than to the number of keys,
+ * and the keys can come from a stream that cannot be read twice. The index is the same that @ref PGMIndex builds
+ * sequentially on the same keys.
+ *
+ * @tparam K the type of the indexed keys
+ * @tparam Epsilon controls the size of the returned search range
+ * @tparam EpsilonRecursive controls the size of the search range in the internal structure
+ * @tparam Floating the floating-point type to use for slopes
+ * @tparam Intercept the signed integer type to use for intercepts
+ */
+template<typename K, size_t Epsilon = 64, size_t EpsilonRecursive = 4, typename Floating = float,
+         typename Intercept = int32_t>
+class PGMIndexBuilder {
+    using Index = PGMIndex<K, Epsilon, EpsilonRecursive, Floating, Intercept>;
+
+    Index index;                                      ///< The index being built.
+    internal::OptimalPiecewiseLinearModel<K, size_t> opt;///< The model of the segment being built.
+    size_t n_segments;                                ///< The number of segments emitted in the first level.
+    K previous_key;                                   ///< The key before the pending one.
+    K pending_key;                                    ///< The last key pushed, not yet added to the model.
+    K last_x;                                         ///< The abscissa of the last point added to the model.
+    bool model_empty;                                 ///< Whether no point has been added to the model.
+
+    void add_point(const K &x, size_t y) {
+        if (!model_empty && x == last_x)
+            return;
+        last_x = x;
+        model_empty = false;
+        if (!opt.add_point(x, y)) {
+            index.segments.emplace_back(opt.get_segment());
+            opt.add_point(x, y);
+            ++n_segments;
+        }
+    }
+
+    void clear(PagePolicy policy) {
+        index = Index();
+        index.n = 0;
+        index.first_key = K(0);
+        index.segments = decltype(index.segments)(AlignedAllocator<typename Index::Segment>(policy));
+        opt.reset();
+        n_segments = 0;
+        model_empty = true;
+    }
+
+public:
+
+    /**
+     * Constructs a builder of an empty index.
+     * @param policy the kind of memory pages that back the segments of the index
+     */
+    explicit PGMIndexBuilder(PagePolicy policy = PagePolicy::Regular)
+        : index(),
+          opt(Epsilon),
+          n_segments(0),
+          previous_key(),
+          pending_key(),
+          last_x(),
+          model_empty(true) {
+        clear(policy);
+    }
+
+    /**
+     * Adds a key to the index, which must not be less than the keys added so far.
+     * @param key the key to add
+     */
+    void push(const K &key) {
+        auto i = index.n;
+        if (i == 0) {
+            index.first_key = key;
+        } else {
+            if (key < pending_key)
+                throw std::invalid_argument("The keys must be pushed in sorted order");
+            // Same adjustment for duplicate keys of PGMIndex::build, now that the key after pending_key is known
+            auto x = pending_key;
+            auto flag = i > 1 && x == previous_key && x != key && x + 1 != key;
+            add_point(x + flag, i - 1);
+            previous_key = pending_key;
+        }
+        pending_key = key;
+        ++index.n;
+    }
+
+    /**
+     * Adds the keys in the range [first, last), which must be sorted and not less than the keys added so far.
+     * @param first, last the range containing the keys to add
+     */
+    template<typename InputIt>
+    void push(InputIt first, InputIt last) {
+        for (; first != last; ++first)
+            push(*first);
+    }
+
+    /**
+     * Returns the number of keys added so far.
+     * @return the number of keys added so far
+     */
+    size_t size() const { return index.n; }
+
+    /**
+     * Builds the upper levels of the index and returns it. The builder is left empty.
+     * @return the index on the keys added so far
+     */
+    Index finish() {
+        auto n = index.n;
+        if (n > 0) {
+            auto ignore_last = n > 1 && pending_key == std::numeric_limits<K>::max(); // max() is the sentinel value
+            if (!ignore_last)
+                add_point(pending_key, n - 1);
+            index.segments.emplace_back(opt.get_segment());
+            index.levels_offsets.push_back(0);
+            Index::build_upper_levels(n - ignore_last, n_segments + 1, ignore_last ? previous_key : pending_key,
+                                      EpsilonRecursive, index.segments, index.levels_offsets);
+        }
+
+        auto result = std::move(index);
+        clear(result.segments.get_allocator().page_policy());
+        return result;
+    }
+};
+
 #pragma pack(push, 1)
 
-template<typename K, size_t Epsilon, size_t EpsilonRecursive, typename Floating>
-struct PGMIndex<K, Epsilon, EpsilonRecursive, Floating>::Segment {
-    K key;             ///< The first key that the segment indexes.
-    Floating slope;    ///< The slope of the segment.
-    int32_t intercept; ///< The intercept of the segment.
+template<typename K, size_t Epsilon, size_t EpsilonRecursive, typename Floating, typename Intercept>
+struct PGMIndex<K, Epsilon, EpsilonRecursive, Floating, Intercept>::Segment {
+    K key;               ///< The first key that the segment indexes.
+    Floating slope;      ///< The slope of the segment.
+    Intercept intercept; ///< The intercept of the segment.
 
     Segment() = default;
 
-    Segment(K key, Floating slope, int32_t intercept) : key(key), slope(slope), intercept(intercept) {};
+    Segment(K key, Floating slope, Intercept intercept) : key(key), slope(slope), intercept(intercept) {};
 
-    explicit Segment(size_t n) : key(std::numeric_limits<K>::max()), slope(), intercept(n) {};
+    explicit Segment(size_t n) : key(std::numeric_limits<K>::max()), slope(), intercept(n) {
+        if (n > size_t(std::numeric_limits<Intercept>::max()))
+            throw std::overflow_error("Change the Intercept type of PGMIndex to int64_t");
+    };
 
     explicit Segment(const typename internal::OptimalPiecewiseLinearModel<K, size_t>::CanonicalSegment &cs)
         : key(cs.get_first_x()) {
         auto[cs_slope, cs_intercept] = cs.get_floating_point_segment(key);
         if (cs_intercept > std::numeric_limits<decltype(intercept)>::max())
-            throw std::overflow_error("Change the type of Segment::intercept to int64");
+            throw std::overflow_error("Change the Intercept type of PGMIndex to int64_t");
         slope = cs_slope;
         intercept = cs_intercept;
     }
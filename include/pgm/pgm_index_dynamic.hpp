@@ -19,22 +19,208 @@
 #include <cstddef>
 #include <cstdint>
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <condition_variable>
+#include <functional>
 #include <iterator>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <new>
+#include <optional>
 #include <set>
 #include <stdexcept>
+#include <thread>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
 namespace pgm {
 
+template<typename K, typename V, typename PGMType>
+class ConcurrentDynamicPGMIndex;
+
+namespace internal {
+
+/**
+ * A blocked Bloom filter, which maps a key to a block of 512 bits (a cache line) and sets one bit in each of the eight
+ * words of the block.
+ * @tparam K the type of the keys, which must be hashable with std::hash
+ */
+template<typename K>
+class BlockedBloomFilter {
+    struct alignas(64) Block {
+        uint64_t words[8];
+    };
+
+    std::vector<Block> blocks;
+
+public:
+
+    /** Returns the hash of @p key, which scrambles the bits of std::hash as the latter can be the identity. */
+    static uint64_t hash(const K &key) {
+        uint64_t h = std::hash<K>()(key);
+        h = (h ^ (h >> 33)) * 0xff51afd7ed558ccdull;
+        h = (h ^ (h >> 33)) * 0xc4ceb9fe1a85ec53ull;
+        return h ^ (h >> 33);
+    }
+
+    BlockedBloomFilter() = default;
+
+    /**
+     * Constructs an empty filter.
+     * @param capacity the number of keys to be inserted
+     * @param bits_per_key the number of bits of the filter for each key, which determines its false positive rate
+     */
+    BlockedBloomFilter(size_t capacity, size_t bits_per_key)
+        : blocks(std::max<size_t>(1, (capacity * bits_per_key + 511) / 512)) {}
+
+    /**
+     * Inserts the keys of the items in the range [first, last) into the filter.
+     * @param first, last the range containing the items, whose key is the member first
+     */
+    template<typename Iterator>
+    void insert(Iterator first, Iterator last) {
+        // Hash and prefetch a chunk of keys before setting their bits, to overlap the cache misses on large filters
+        constexpr size_t chunk = 32;
+        uint64_t hashes[chunk];
+        while (first != last) {
+            auto n = std::min<size_t>(chunk, std::distance(first, last));
+            for (size_t i = 0; i < n; ++i, ++first) {
+                hashes[i] = hash(first->first);
+                prefetch(hashes[i]);
+            }
+            for (size_t i = 0; i < n; ++i)
+                insert(hashes[i]);
+        }
+    }
+
+    /**
+     * Inserts the key with the given hash into the filter.
+     * @param h the hash of the key, computed by @ref hash
+     * @return false if the key was certainly not in the filter before, true otherwise
+     */
+    bool insert(uint64_t h) {
+        auto &block = blocks[block_index(h)];
+        uint64_t result = 1;
+        for (auto j = 0; j < 8; ++j) {
+            result &= block.words[j] >> ((h >> (6 * j)) & 63);
+            block.words[j] |= uint64_t(1) << ((h >> (6 * j)) & 63);
+        }
+        return result;
+    }
+
+    /**
+     * Checks whether the filter has been constructed with a non-zero capacity.
+     * @return true if the filter has no space for keys, false otherwise
+     */
+    bool empty() const { return blocks.empty(); }
+
+    /**
+     * Checks whether a key with the given hash may be in the filter.
+     * @param h the hash of the key, computed by @ref hash
+     * @return false if the key is certainly not in the filter, true otherwise
+     */
+    bool may_contain(uint64_t h) const {
+        auto &block = blocks[block_index(h)];
+        uint64_t result = 1;
+        for (auto j = 0; j < 8; ++j)
+            result &= block.words[j] >> ((h >> (6 * j)) & 63);
+        return result;
+    }
+
+    /** Prefetches the block of the filter that may_contain accesses for the key with hash @p h. */
+    void prefetch(uint64_t h) const { __builtin_prefetch(&blocks[block_index(h)], 0, 0); }
+
+    /**
+     * Returns the size of the filter in bytes.
+     * @return the size of the filter in bytes
+     */
+    size_t size_in_bytes() const { return blocks.size() * sizeof(Block); }
+
+private:
+
+    size_t block_index(uint64_t h) const {
+        return size_t((unsigned __int128) (h * 0x9e3779b97f4a7c15ull) * blocks.size() >> 64);
+    }
+};
+
+/**
+ * Epoch-based reclamation of the objects that writers replace in an atomic pointer while readers may still use them.
+ *
+ * A reader announces the current epoch in a free slot before loading the pointer, and frees the slot when it no longer
+ * uses the object. A writer that replaces an object advances the epoch, and the replaced object can be deleted once
+ * every announced epoch is at least the advanced one, because the readers that announced it loaded the pointer after
+ * the replacement. Readers never wait for writers: a reader only writes its own slot, which is padded to a cache line
+ * and chosen from the id of its thread, so that readers on different cores do not write to the same cache line.
+ */
+class EpochDomain {
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch{0}; ///< The epoch announced by the reader using the slot, or 0 if it is free.
+    };
+
+    std::atomic<uint64_t> epoch;
+    std::unique_ptr<Slot[]> slots;
+    size_t slots_count;
+
+public:
+
+    /**
+     * Constructs a domain with the given number of slots, which bounds the number of readers that do not wait for
+     * another reader to free a slot.
+     * @param slots_count the number of slots
+     */
+    explicit EpochDomain(size_t slots_count) : epoch(1), slots(new Slot[slots_count]), slots_count(slots_count) {}
+
+    /**
+     * Announces the current epoch in a free slot. The caller can then load the pointer and use the object until it
+     * calls @ref exit.
+     * @return the index of the slot to pass to @ref exit
+     */
+    size_t enter() {
+        auto h = std::hash<std::thread::id>()(std::this_thread::get_id()) * 0x9e3779b97f4a7c15ull;
+        auto i = size_t((unsigned __int128) h * slots_count >> 64);
+        for (size_t probes = 1;; ++probes) {
+            uint64_t expected = 0;
+            if (slots[i].epoch.load(std::memory_order_relaxed) == 0
+                && slots[i].epoch.compare_exchange_strong(expected, epoch.load()))
+                return i;
+            i = i + 1 == slots_count ? 0 : i + 1;
+            if (probes % slots_count == 0)
+                std::this_thread::yield();
+        }
+    }
+
+    /** Frees the slot returned by @ref enter, after which the reader must not use the loaded object anymore. */
+    void exit(size_t slot) { slots[slot].epoch.store(0, std::memory_order_release); }
+
+    /**
+     * Advances the epoch. The caller must have already replaced the object in the atomic pointer.
+     * @return the epoch that all the readers must have announced before the replaced object can be deleted
+     */
+    uint64_t advance() { return epoch.fetch_add(1) + 1; }
+
+    /**
+     * Returns the smallest epoch announced by the readers.
+     * @return the smallest announced epoch, or the maximum value of uint64_t if there are no readers
+     */
+    uint64_t min_announced() const {
+        auto result = std::numeric_limits<uint64_t>::max();
+        for (size_t i = 0; i < slots_count; ++i) {
+            auto e = slots[i].epoch.load();
+            if (e != 0)
+                result = std::min(result, e);
+        }
+        return result;
+    }
+};
+
+} // namespace internal
+
 /**
  * A sorted associative container that contains key-value pairs with unique keys.
- * @tparam K the type of a key
+ * @tparam K the type of a key, which must be hashable with std::hash for the filters on the keys
  * @tparam V the type of a value
  * @tparam PGMType the type of @ref PGMIndex to use in the container
  */
@@ -44,21 +230,37 @@ class DynamicPGMIndex {
     class ItemB;
     class Iterator;
 
+    template<typename, typename, typename>
+    friend class ConcurrentDynamicPGMIndex;
+
     using Item = std::conditional_t<std::is_pointer_v<V> || std::is_arithmetic_v<V>, ItemA, ItemB>;
     using Level = std::vector<Item>;
+    using Filter = internal::BlockedBloomFilter<K>;
+
+    constexpr static size_t key_filter_bits_per_key = 10;
+    constexpr static size_t min_filter_capacity = size_t(1) << 16;
 
     const uint8_t base;            ///< base^i is the maximum size of the ith level.
     const uint8_t min_level;       ///< Levels 0..min_level are combined into one large level.
     const uint8_t min_index_level; ///< Minimum level on which an index is constructed.
+    const uint8_t filter_bits;     ///< Bits per key of the filters on the levels > min_level, or 0 if there are none.
+    const bool track_size;         ///< Whether live_count and key_filter are maintained to speed up size().
     size_t buffer_max_size;        ///< Size of the combined upper levels, i.e. max_size(0) + ... + max_size(min_level).
     uint8_t used_levels;           ///< Equal to 1 + last level whose size is greater than 0, or = min_level if no data.
+    size_t live_count;             ///< Number of keys whose newest item below the buffer level is not deleted.
     std::vector<Level> levels;     ///< (i-min_level)th element is the data array at the ith level.
     std::vector<PGMType> pgms;     ///< (i-min_index_level)th element is the index at the ith level.
+    Filter key_filter;             ///< Filter on the keys that entered the levels below the buffer since its rebuild.
+    size_t key_filter_count;       ///< Number of keys inserted in key_filter, which is rebuilt when above its capacity.
+    size_t key_filter_capacity;    ///< Number of keys key_filter has been sized for.
+    std::vector<Filter> filters;   ///< (i-min_level)th element is the filter on the keys at the ith level > min_level.
 
     const Level &level(uint8_t level) const { return levels[level - min_level]; }
     const PGMType &pgm(uint8_t level) const { return pgms[level - min_index_level]; }
     Level &level(uint8_t level) { return levels[level - min_level]; }
     PGMType &pgm(uint8_t level) { return pgms[level - min_index_level]; }
+    const Filter &filter(uint8_t level) const { return filters[level - min_level]; }
+    Filter &filter(uint8_t level) { return filters[level - min_level]; }
     bool has_pgm(uint8_t level) const { return level >= min_index_level; }
     size_t max_size(uint8_t level) const { return size_t(1) << (level * ceil_log2(base)); }
     uint8_t max_fully_allocated_level() const { return min_level + 2; }
@@ -69,15 +271,28 @@ class DynamicPGMIndex {
                         uint8_t target,
                         size_t size_hint,
                         typename Level::iterator insertion_point) {
-        Level tmp_a(size_hint + level(target).size());
-        Level tmp_b(size_hint + level(target).size());
+        Level tmp(size_hint + level(target).size());
 
         // Insert new_item in sorted order in the first level
-        auto alternate = true;
-        auto it = std::move(level(min_level).begin(), insertion_point, tmp_a.begin());
+        auto it = std::move(level(min_level).begin(), insertion_point, tmp.begin());
         *it++ = new_item;
         it = std::move(insertion_point, level(min_level).end(), it);
-        auto tmp_size = std::distance(tmp_a.begin(), it);
+        auto tmp_size = std::distance(tmp.begin(), it);
+        merge_into(target, std::move(tmp), tmp_size);
+    }
+
+    /**
+     * Merges the first @p tmp_size items of @p tmp_a, which are newer than the ones in the levels and replace the first
+     * level, with the levels up to @p target, and stores the result in @p target. The size of @p tmp_a must be enough
+     * to hold the result.
+     */
+    void merge_into(uint8_t target, Level tmp_a, std::ptrdiff_t tmp_size) {
+        if (track_size) {
+            live_count += count_changes(tmp_a.begin(), tmp_a.begin() + tmp_size, key_filter);
+            key_filter_count += tmp_size;
+        }
+        Level tmp_b(tmp_a.size());
+        auto alternate = true;
 
         // Merge subsequent levels
         uint8_t merge_limit = level(target).empty() ? target - 1 : target;
@@ -94,21 +309,149 @@ class DynamicPGMIndex {
                 out_end = merge<false, true>(tmp_begin, tmp_end, level(i).begin(), level(i).end(), out_begin);
             tmp_size = std::distance(out_begin, out_end);
 
-            // Empty this level and the corresponding index
+            // Empty this level and the corresponding index and filter
             level(i).clear();
             if (i >= max_fully_allocated_level())
                 level(i).shrink_to_fit();
             if (has_pgm(i))
                 pgm(i) = PGMType();
+            filter(i) = Filter();
         }
 
         level(min_level).clear();
         level(target) = std::move(alternate ? tmp_a : tmp_b);
         level(target).resize(tmp_size);
 
-        // Rebuild index, if needed
+        // Rebuild index and filter, if needed
         if (has_pgm(target))
             pgm(target) = PGMType(level(target).begin(), level(target).end());
+        build_filter(target);
+        if (key_filter_count > key_filter_capacity)
+            rebuild_key_filter();
+    }
+
+    /** Builds the filter on the keys of the given level, if the filters are enabled. */
+    void build_filter(uint8_t level_number) {
+        if (filter_bits == 0)
+            return;
+        auto &l = level(level_number);
+        filter(level_number) = Filter(l.size(), filter_bits);
+        filter(level_number).insert(l.begin(), l.end());
+    }
+
+    /** Rebuilds the key filter on the keys in the levels below the buffer, with room for as many new keys. */
+    void rebuild_key_filter() {
+        key_filter_count = 0;
+        for (auto i = min_level + 1; i < used_levels; ++i)
+            key_filter_count += level(i).size();
+        key_filter_capacity = std::max(2 * key_filter_count, min_filter_capacity);
+        key_filter = Filter(key_filter_capacity, key_filter_bits_per_key);
+        for (auto i = min_level + 1; i < used_levels; ++i)
+            key_filter.insert(level(i).begin(), level(i).end());
+    }
+
+    /**
+     * Returns the level number and the position of the newest item with key @p key in the levels from @p first_level,
+     * or a level number equal to used_levels if there is no such item. The levels below the buffer are skipped if the
+     * key filter excludes the key, and each of them is skipped if its own filter excludes the key.
+     */
+    std::pair<uint8_t, typename Level::const_iterator> find_newest(const K &key, uint8_t first_level) const {
+        auto key_filter_checked = key_filter.empty();
+        uint64_t h = key_filter_checked && filter_bits == 0 ? 0 : Filter::hash(key);
+        if (!key_filter_checked)
+            key_filter.prefetch(h);
+
+        for (auto i = first_level; i < used_levels; ++i) {
+            if (i > min_level && !key_filter_checked) {
+                if (!key_filter.may_contain(h))
+                    break;
+                key_filter_checked = true;
+            }
+            if (level(i).empty() || (i > min_level && !filter(i).empty() && !filter(i).may_contain(h)))
+                continue;
+
+            auto first = level(i).begin();
+            auto last = level(i).end();
+            if (has_pgm(i)) {
+                auto range = pgm(i).search(key);
+                first = level(i).begin() + range.lo;
+                last = level(i).begin() + range.hi;
+            }
+
+            auto it = lower_bound_bl(first, last, key);
+            if (it != level(i).end() && it->first == key)
+                return {i, it};
+        }
+
+        return {used_levels, levels.back().end()};
+    }
+
+    /**
+     * Returns the change in the number of live keys of the levels below the buffer if the items in the sorted range
+     * [first, last) replaced the newest items with the same keys in those levels. The keys excluded by the key filter
+     * are new, while the others are searched level by level in increasing order. If @p filter is not const, it is the
+     * key filter and the keys are also inserted into it, as they are about to enter the levels.
+     */
+    template<typename ItemIterator, typename FilterType>
+    std::ptrdiff_t count_changes(ItemIterator first, ItemIterator last, FilterType &filter) const {
+        constexpr size_t prefetch_distance = 16;
+        auto n = size_t(std::distance(first, last));
+        std::vector<int8_t> was_live(n, -1); // -1 until the newest item with the key is found
+        size_t unresolved = n;
+
+        if (!filter.empty()) {
+            uint64_t hashes[prefetch_distance];
+            for (size_t j = 0; j < n + prefetch_distance; ++j) {
+                auto &h = hashes[j % prefetch_distance];
+                if (j >= prefetch_distance) {
+                    bool may_contain;
+                    if constexpr (std::is_const_v<FilterType>)
+                        may_contain = filter.may_contain(h);
+                    else
+                        may_contain = filter.insert(h);
+                    if (!may_contain) {
+                        was_live[j - prefetch_distance] = 0;
+                        --unresolved;
+                    }
+                }
+                if (j < n) {
+                    h = Filter::hash(first[j].first);
+                    filter.prefetch(h);
+                }
+            }
+        }
+
+        for (auto i = min_level + 1; i < used_levels && unresolved > 0; ++i) {
+            if (level(i).empty())
+                continue;
+
+            auto pos = level(i).begin();
+            auto linear_scan = level(i).size() <= 16 * unresolved;
+            for (size_t j = 0; j < n; ++j) {
+                auto &key = first[j].first;
+                if (was_live[j] >= 0)
+                    continue;
+
+                if (has_pgm(i)) {
+                    auto range = pgm(i).search(key);
+                    auto lo = std::max(pos, level(i).begin() + range.lo);
+                    pos = lower_bound_bl(lo, level(i).begin() + range.hi, key);
+                } else if (linear_scan) {
+                    while (pos != level(i).end() && pos->first < key)
+                        ++pos;
+                } else
+                    pos = exponential_search(pos, level(i).end(), key);
+                if (pos != level(i).end() && pos->first == key) {
+                    was_live[j] = !pos->deleted();
+                    --unresolved;
+                }
+            }
+        }
+
+        std::ptrdiff_t changes = 0;
+        for (size_t j = 0; j < n; ++j)
+            changes += int(!first[j].deleted()) - (was_live[j] == 1);
+        return changes;
     }
 
     void insert(const Item &new_item) {
@@ -137,6 +480,7 @@ class DynamicPGMIndex {
         if (need_new_level) {
             ++used_levels;
             levels.emplace_back();
+            filters.emplace_back();
             if (i - min_index_level >= int(pgms.size()))
                 pgms.emplace_back();
         }
@@ -144,6 +488,61 @@ class DynamicPGMIndex {
         pairwise_merge(new_item, i, slots_required, insertion_point);
     }
 
+    /** Inserts the items in @p batch, where the last item of those with the same key is the newest. */
+    void bulk_insert(Level batch) {
+        // Sort by key and keep only the newest item of each key
+        auto less = [](const Item &a, const Item &b) { return a.first < b.first; };
+        if (!std::is_sorted(batch.begin(), batch.end(), less))
+            std::stable_sort(batch.begin(), batch.end(), less);
+        auto out = batch.begin();
+        for (auto it = batch.begin(); it != batch.end(); ++it) {
+            if (std::next(it) != batch.end() && std::next(it)->first == it->first)
+                continue;
+            if (out != it)
+                *out = std::move(*it);
+            ++out;
+        }
+        batch.erase(out, batch.end());
+        if (batch.empty())
+            return;
+
+        auto &buffer = level(min_level);
+        size_t slots_required = batch.size() + buffer.size();
+        if (slots_required <= buffer_max_size) {
+            Level tmp(slots_required);
+            auto tmp_end = merge<false, true>(batch.begin(), batch.end(), buffer.begin(), buffer.end(), tmp.begin());
+            buffer.assign(std::make_move_iterator(tmp.begin()), std::make_move_iterator(tmp_end));
+            used_levels = used_levels == min_level ? min_level + 1 : used_levels;
+            return;
+        }
+
+        // Find the first level that can hold the batch and the levels above it, possibly one beyond the last
+        uint8_t i;
+        for (i = min_level + 1; i < used_levels; ++i) {
+            auto slots_left_in_level = max_size(i) - level(i).size();
+            if (slots_required <= slots_left_in_level)
+                break;
+            slots_required += level(i).size();
+        }
+        while (i >= used_levels && max_size(i) < slots_required)
+            ++i;
+
+        if (i >= used_levels) {
+            used_levels = i + 1;
+            if (levels.size() < size_t(used_levels - min_level)) {
+                levels.resize(used_levels - min_level);
+                filters.resize(levels.size());
+            }
+            if (has_pgm(i) && pgms.size() < size_t(used_levels - min_index_level))
+                pgms.resize(used_levels - min_index_level);
+        }
+
+        Level tmp(slots_required + level(i).size());
+        auto tmp_end = merge<false, true>(batch.begin(), batch.end(), buffer.begin(), buffer.end(), tmp.begin());
+        auto tmp_size = std::distance(tmp.begin(), tmp_end);
+        merge_into(i, std::move(tmp), tmp_size);
+    }
+
 public:
 
     using key_type = K;
@@ -157,15 +556,27 @@ public:
      * @param base determines the size of the ith level as base^i
      * @param buffer_level determines the size of level 0, equal to the sum of base^i for i = 0, ..., buffer_level
      * @param index_level the minimum level at which an index is constructed to speed up searches
+     * @param filter_bits the number of bits per key of the filters that let @ref find skip the levels not containing
+     *                    the key (e.g. 10 for a false positive rate of about 1%), or 0 to build no such filter
+     * @param track_size whether to maintain the number of elements and a filter on the keys that let @ref size avoid a
+     *                   scan of the container, at the cost of slower insertions and about 1.25 bytes per key
      */
-    DynamicPGMIndex(uint8_t base = 8, uint8_t buffer_level = 0, uint8_t index_level = 0)
+    DynamicPGMIndex(uint8_t base = 8, uint8_t buffer_level = 0, uint8_t index_level = 0, uint8_t filter_bits = 0,
+                    bool track_size = false)
         : base(base),
           min_level(buffer_level ? buffer_level : ceil_log_base(128) - (base == 2)),
           min_index_level(std::max<size_t>(min_level + 1, index_level ? index_level : ceil_log_base(size_t(1) << 24))),
+          filter_bits(filter_bits),
+          track_size(track_size),
           buffer_max_size(),
           used_levels(min_level),
+          live_count(),
           levels(),
-          pgms() {
+          pgms(),
+          key_filter(),
+          key_filter_count(),
+          key_filter_capacity(),
+          filters() {
         if (base < 2 || (base & (base - 1u)) != 0)
             throw std::invalid_argument("base must be a power of two");
 
@@ -173,6 +584,7 @@ public:
             buffer_max_size += max_size(j);
 
         levels.resize(32 - used_levels);
+        filters.resize(levels.size());
         level(min_level).reserve(buffer_max_size);
         for (uint8_t i = min_level + 1; i < max_fully_allocated_level(); ++i)
             level(i).reserve(max_size(i));
@@ -185,13 +597,19 @@ public:
      * @param base determines the size of the ith level as base^i
      * @param buffer_level determines the size of level 0, equal to the sum of base^i for i = 0, ..., buffer_level
      * @param index_level the minimum level at which an index is constructed to speed up searches
+     * @param filter_bits the number of bits per key of the filters that let @ref find skip the levels not containing
+     *                    the key (e.g. 10 for a false positive rate of about 1%), or 0 to build no such filter
+     * @param track_size whether to maintain the number of elements and a filter on the keys that let @ref size avoid a
+     *                   scan of the container, at the cost of slower insertions and about 1.25 bytes per key
      */
-    template<typename Iterator>
-    DynamicPGMIndex(Iterator first, Iterator last, uint8_t base = 8, uint8_t buffer_level = 0, uint8_t index_level = 0)
-        : DynamicPGMIndex(base, buffer_level, index_level) {
+    template<typename Iterator, std::enable_if_t<!std::is_integral_v<Iterator>, int> = 0>
+    DynamicPGMIndex(Iterator first, Iterator last, uint8_t base = 8, uint8_t buffer_level = 0,
+                    uint8_t index_level = 0, uint8_t filter_bits = 0, bool track_size = false)
+        : DynamicPGMIndex(base, buffer_level, index_level, filter_bits, track_size) {
         size_t n = std::distance(first, last);
         used_levels = std::max<uint8_t>(ceil_log_base(n), min_level) + 1;
         levels.resize(std::max<uint8_t>(used_levels, 32) - min_level + 1);
+        filters.resize(levels.size());
         level(min_level).reserve(buffer_max_size);
         for (uint8_t i = min_level + 1; i < max_fully_allocated_level(); ++i)
             level(i).reserve(max_size(i));
@@ -213,6 +631,13 @@ public:
                 *out++ = Item(first->first, first->second);
         }
         target.resize(std::distance(target.begin(), out));
+        if (used_levels - 1 > min_level) {
+            if (track_size) {
+                live_count = target.size(); // The buffer is counted by size()
+                rebuild_key_filter();
+            }
+            build_filter(used_levels - 1);
+        }
 
         if (has_pgm(used_levels - 1)) {
             pgms = decltype(pgms)(used_levels - min_index_level);
@@ -234,30 +659,45 @@ public:
      */
     void erase(const K &key) { insert(Item(key)); }
 
+    /**
+     * Inserts or updates the key-value pairs in the range [first, last), as if by calling insert_or_assign on each of
+     * them in order, but with a single merge into the levels. Pairs with the same key can appear in the range, in
+     * which case the last one wins, and the range is sorted by key if it is not already.
+     * @tparam Iterator
+     * @param first, last the range containing the key-value pairs to insert or update
+     */
+    template<typename Iterator>
+    void bulk_upsert(Iterator first, Iterator last) {
+        Level batch;
+        batch.reserve(std::distance(first, last));
+        for (; first != last; ++first)
+            batch.emplace_back(first->first, first->second);
+        bulk_insert(std::move(batch));
+    }
+
+    /**
+     * Removes the elements with the keys in the range [first, last), as if by calling erase on each of them, but with
+     * a single merge into the levels.
+     * @tparam Iterator
+     * @param first, last the range containing the keys of the elements to remove
+     */
+    template<typename Iterator>
+    void bulk_erase(Iterator first, Iterator last) {
+        Level batch;
+        batch.reserve(std::distance(first, last));
+        for (; first != last; ++first)
+            batch.emplace_back(*first);
+        bulk_insert(std::move(batch));
+    }
+
     /**
      * Finds an element with key equivalent to @p key.
      * @param key key value of the element to search for
      * @return an iterator to an element with key equivalent to @p key. If no such element is found, end() is returned
      */
     iterator find(const K &key) const {
-        for (auto i = min_level; i < used_levels; ++i) {
-            if (level(i).empty())
-                continue;
-
-            auto first = level(i).begin();
-            auto last = level(i).end();
-            if (has_pgm(i)) {
-                auto range = pgm(i).search(key);
-                first = level(i).begin() + range.lo;
-                last = level(i).begin() + range.hi;
-            }
-
-            auto it = lower_bound_bl(first, last, key);
-            if (it != level(i).end() && it->first == key)
-                return it->deleted() ? end() : iterator(this, i, it);
-        }
-
-        return end();
+        auto [i, it] = find_newest(key, min_level);
+        return i == used_levels || it->deleted() ? end() : iterator(this, i, it);
     }
 
     /**
@@ -386,12 +826,15 @@ public:
     size_t count(const K &key) const { return find(key) == end() ? 0 : 1; }
 
     /**
-     * Returns the number of elements in the container.
+     * Returns the number of elements in the container. This scans the container, unless it was constructed with
+     * track_size. In that case, the count for the levels below the buffer is maintained by the merges, and only the
+     * buffered keys are looked up, so the cost depends on the buffer size rather than on the number of elements.
      * @return the number of elements in the container
      */
     size_t size() const {
-        // TODO: scanning the levels and using a hash table for the encountered keys could be more time efficient
-        return std::distance(begin(), end());
+        if (!track_size)
+            return std::distance(begin(), end());
+        return live_count + count_changes(level(min_level).begin(), level(min_level).end(), key_filter);
     }
 
     /**
@@ -413,7 +856,9 @@ public:
         size_t bytes = 0;
         for (auto &p: pgms)
             bytes += p.size_in_bytes();
-        return bytes;
+        for (auto &f: filters)
+            bytes += f.size_in_bytes();
+        return bytes + key_filter.size_in_bytes();
     }
 
 private:
@@ -447,6 +892,16 @@ private:
         return std::copy(first2, last2, std::copy(first1, last1, result));
     }
 
+    /** Returns the first position in [first, last) not less than @p x, in time logarithmic in its distance to first. */
+    template<class RandomIt>
+    static RandomIt exponential_search(RandomIt first, RandomIt last, const K &x) {
+        auto n = size_t(std::distance(first, last));
+        size_t bound = 1;
+        while (bound < n && first[bound].first < x)
+            bound *= 2;
+        return lower_bound_bl(first + bound / 2, first + std::min(bound + 1, n), x);
+    }
+
     template<class RandomIt>
     static RandomIt lower_bound_bl(RandomIt first, RandomIt last, const K &x) {
         if (first == last)
@@ -714,4 +1169,563 @@ public:
 
 #pragma pack(pop)
 
+/**
+ * A sorted associative container that contains key-value pairs with unique keys, like @ref DynamicPGMIndex, and that
+ * can be shared by any number of reader and writer threads.
+ *
+ * The levels built by the merges are immutable and, together with a copy-on-write insertion buffer, form a version of
+ * the container that writers publish with an atomic pointer swap. Readers search the version that is current at the
+ * start of a query, so they never wait for an insertion or a merge, and they do not write to any shared memory
+ * location, as a replaced version is freed by the writers with epoch-based reclamation once no reader can be using
+ * it. Writers are serialized.
+ *
+ * Optionally, a full buffer is frozen and merged into the levels by a background thread, while the insertions go to a
+ * new buffer. Insertions block only if the frozen buffers waiting for a merge reach a given limit.
+ *
+ * @tparam K the type of a key
+ * @tparam V the type of a value
+ * @tparam PGMType the type of @ref PGMIndex to use in the container
+ */
+template<typename K, typename V, typename PGMType = PGMIndex<K, 16>>
+class ConcurrentDynamicPGMIndex {
+    using Base = DynamicPGMIndex<K, V, PGMType>;
+    using Item = typename Base::value_type;
+    using Level = std::vector<Item>;
+
+    /** An immutable level, with the index on its items if the level is at least min_index_level. */
+    struct Run {
+        Level items;
+        PGMType pgm;
+    };
+
+    using Runs = std::vector<std::shared_ptr<const Run>>;
+
+    /** The state of the container published to the readers. */
+    struct Version {
+        std::shared_ptr<const Level> buffer;              ///< The items of the combined levels 0..min_level.
+        std::vector<std::shared_ptr<const Level>> frozen; ///< The full buffers waiting for a merge, oldest first.
+        Runs runs;                                        ///< (i-min_level-1)th element is the ith level, or nullptr.
+    };
+
+    const uint8_t base;            ///< base^i is the maximum size of the ith level.
+    const uint8_t min_level;       ///< Levels 0..min_level are combined into one large level.
+    const uint8_t min_index_level; ///< Minimum level on which an index is constructed.
+    const uint8_t max_frozen;      ///< Maximum number of frozen buffers, or 0 if merges run on the writer thread.
+    size_t buffer_max_size;        ///< Size of the combined upper levels, i.e. max_size(0) + ... + max_size(min_level).
+    std::atomic<const Version *> version;   ///< The current version, which is replaced only under write_mutex.
+    mutable internal::EpochDomain epochs;   ///< The epochs announced by the readers of the versions.
+    std::vector<std::pair<uint64_t, const Version *>> retired; ///< The replaced versions and their retire epoch.
+    std::mutex write_mutex;                 ///< Serializes the writers and the background merges.
+    std::condition_variable merge_requested; ///< Notified when a buffer is frozen or the container is destroyed.
+    std::condition_variable merge_completed; ///< Notified when a frozen buffer has been merged.
+    bool stopping;                           ///< true iff the background thread must terminate.
+    std::thread merger;                      ///< The background thread, if max_frozen > 0.
+
+    size_t max_size(uint8_t level) const { return size_t(1) << (level * Base::ceil_log2(base)); }
+    uint8_t ceil_log_base(size_t n) const {
+        return (Base::ceil_log2(n) + Base::ceil_log2(base) - 1) / Base::ceil_log2(base);
+    }
+
+    static constexpr size_t reclaim_period = 16; ///< The number of replaced versions that triggers their reclamation.
+
+    /** Returns the current version. The caller must hold write_mutex, otherwise the version may be freed. */
+    const Version &current() const { return *version.load(std::memory_order_relaxed); }
+
+    /**
+     * Replaces the current version with @p next. The caller must hold write_mutex. The replaced versions are freed
+     * after a merge, so that the replaced levels are released soon, or once reclaim_period of them are waiting.
+     */
+    void publish(std::unique_ptr<const Version> next) {
+        auto merged = version.load(std::memory_order_relaxed) && current().runs != next->runs;
+        if (auto old = version.exchange(next.release()))
+            retired.emplace_back(epochs.advance(), old);
+        if (merged || retired.size() >= reclaim_period)
+            reclaim();
+    }
+
+    /** Frees the replaced versions that no reader can be using. The caller must hold write_mutex. */
+    void reclaim() {
+        auto min_epoch = epochs.min_announced();
+        auto it = retired.begin();
+        for (; it != retired.end() && it->first <= min_epoch; ++it)
+            delete it->second;
+        retired.erase(retired.begin(), it);
+    }
+
+    /** Returns f(snapshot), where the snapshot refers to the current version and must not be used after the call. */
+    template<typename F>
+    auto read(F f) const {
+        struct Guard {
+            internal::EpochDomain &epochs;
+            size_t slot;
+            ~Guard() { epochs.exit(slot); }
+        } guard{epochs, epochs.enter()};
+        return f(Snapshot(version.load(), min_level, min_index_level));
+    }
+
+    /** Merges the sorted @p items, newer than the ones in @p runs, into the first level that can hold them. */
+    void merge_into_runs(Runs &runs, Level items) const {
+        auto level_size = [&](uint8_t i) {
+            auto &run = runs[i - min_level - 1];
+            return run ? run->items.size() : 0;
+        };
+
+        auto used_levels = size_t(min_level) + 1 + runs.size();
+        auto slots_required = items.size();
+        uint8_t target;
+        for (target = min_level + 1; target < used_levels; ++target) {
+            auto slots_left_in_level = max_size(target) - level_size(target);
+            if (slots_required <= slots_left_in_level)
+                break;
+            slots_required += level_size(target);
+        }
+        while (target >= used_levels && max_size(target) < slots_required)
+            ++target;
+        if (target >= used_levels) {
+            runs.resize(target - min_level);
+            used_levels = target + 1;
+        }
+
+        // Merge the levels up to the target, newest first
+        auto tmp_size = std::distance(items.begin(), items.end());
+        Level tmp_a = std::move(items);
+        tmp_a.resize(slots_required + level_size(target));
+        Level tmp_b(tmp_a.size());
+        auto alternate = true;
+
+        for (uint8_t i = min_level + 1; i <= target; ++i) {
+            auto &run = runs[i - min_level - 1];
+            if (!run)
+                continue;
+
+            auto tmp_begin = (alternate ? tmp_a : tmp_b).begin();
+            auto tmp_end = tmp_begin + tmp_size;
+            auto out_begin = (alternate ? tmp_b : tmp_a).begin();
+            auto &level = run->items;
+            decltype(out_begin) out_end;
+            if (i == used_levels - 1)
+                out_end = Base::template merge<true, false>(tmp_begin, tmp_end, level.begin(), level.end(), out_begin);
+            else
+                out_end = Base::template merge<false, false>(tmp_begin, tmp_end, level.begin(), level.end(), out_begin);
+            tmp_size = std::distance(out_begin, out_end);
+            alternate = !alternate;
+            run.reset();
+        }
+
+        auto result = std::make_shared<Run>();
+        result->items = std::move(alternate ? tmp_a : tmp_b);
+        result->items.resize(tmp_size);
+        if (target >= min_index_level)
+            result->pgm = PGMType(result->items.begin(), result->items.end());
+        runs[target - min_level - 1] = std::move(result);
+    }
+
+    /**
+     * Body of the background thread, which merges the frozen buffers into the levels until stopping is set. All the
+     * buffers frozen when a merge starts are combined and merged together, so that a backlog of buffers costs a single
+     * merge into the levels.
+     */
+    void merge_frozen() {
+        std::unique_lock<std::mutex> lock(write_mutex);
+        while (true) {
+            merge_requested.wait(lock, [&] { return stopping || !current().frozen.empty(); });
+            if (stopping)
+                return;
+
+            // Merge without holding the lock, as the writers only replace the buffer and append frozen buffers
+            auto runs = current().runs;
+            auto frozen = current().frozen;
+            lock.unlock();
+            merge_into_runs(runs, combine(frozen));
+            lock.lock();
+
+            auto next = std::make_unique<Version>(current());
+            next->frozen.erase(next->frozen.begin(), next->frozen.begin() + frozen.size());
+            next->runs = std::move(runs);
+            publish(std::move(next));
+            merge_completed.notify_all();
+        }
+    }
+
+    /** Returns the sorted items of the given buffers, oldest first, keeping only the newest item of each key. */
+    static Level combine(const std::vector<std::shared_ptr<const Level>> &buffers) {
+        if (buffers.size() == 1)
+            return *buffers.front();
+
+        Level items;
+        for (auto &buffer : buffers)
+            items.insert(items.end(), buffer->begin(), buffer->end());
+        auto less = [](const Item &a, const Item &b) { return a.first < b.first; };
+        std::stable_sort(items.begin(), items.end(), less);
+        auto out = items.begin();
+        for (auto it = items.begin(); it != items.end(); ++it) {
+            if (std::next(it) != items.end() && std::next(it)->first == it->first)
+                continue;
+            *out++ = *it;
+        }
+        items.erase(out, items.end());
+        return items;
+    }
+
+    void insert(const Item &new_item) {
+        std::unique_lock<std::mutex> lock(write_mutex);
+        if (max_frozen > 0) {
+            merge_completed.wait(lock, [&] {
+                return current().buffer->size() < buffer_max_size || current().frozen.size() < max_frozen;
+            });
+        }
+
+        auto next = std::make_unique<Version>(current());
+        auto &buffer = *next->buffer;
+        auto insertion_point = Base::lower_bound_bl(buffer.cbegin(), buffer.cend(), new_item);
+        auto found = insertion_point != buffer.cend() && *insertion_point == new_item;
+
+        if (found || buffer.size() < buffer_max_size) {
+            auto new_buffer = std::make_shared<Level>();
+            new_buffer->reserve(buffer.size() + !found);
+            new_buffer->insert(new_buffer->end(), buffer.cbegin(), insertion_point);
+            new_buffer->push_back(new_item);
+            new_buffer->insert(new_buffer->end(), insertion_point + found, buffer.cend());
+            next->buffer = std::move(new_buffer);
+        } else if (max_frozen > 0) {
+            next->frozen.push_back(std::move(next->buffer));
+            next->buffer = std::make_shared<Level>(1, new_item);
+            merge_requested.notify_one();
+        } else {
+            Level items;
+            items.reserve(buffer.size() + 1);
+            items.insert(items.end(), buffer.cbegin(), insertion_point);
+            items.push_back(new_item);
+            items.insert(items.end(), insertion_point, buffer.cend());
+            merge_into_runs(next->runs, std::move(items));
+            next->buffer = std::make_shared<Level>();
+        }
+
+        publish(std::move(next));
+    }
+
+public:
+
+    class Snapshot;
+
+    using key_type = K;
+    using mapped_type = V;
+    using value_type = Item;
+    using size_type = size_t;
+
+    /**
+     * Constructs an empty container.
+     * @param base determines the size of the ith level as base^i
+     * @param buffer_level determines the size of level 0, equal to the sum of base^i for i = 0, ..., buffer_level
+     * @param index_level the minimum level at which an index is constructed to speed up searches
+     * @param max_frozen_buffers the maximum number of full buffers waiting for a merge in a background thread before
+     *                           an insertion blocks, or 0 to merge the full buffer in the inserting thread
+     */
+    ConcurrentDynamicPGMIndex(uint8_t base = 8, uint8_t buffer_level = 0, uint8_t index_level = 0,
+                              uint8_t max_frozen_buffers = 0)
+        : base(base),
+          min_level(buffer_level ? buffer_level : ceil_log_base(128) - (base == 2)),
+          min_index_level(std::max<size_t>(min_level + 1, index_level ? index_level : ceil_log_base(size_t(1) << 24))),
+          max_frozen(max_frozen_buffers),
+          buffer_max_size(),
+          version(),
+          epochs(std::max<size_t>(64, 4 * std::thread::hardware_concurrency())),
+          retired(),
+          write_mutex(),
+          merge_requested(),
+          merge_completed(),
+          stopping(),
+          merger() {
+        if (base < 2 || (base & (base - 1u)) != 0)
+            throw std::invalid_argument("base must be a power of two");
+
+        for (auto j = 0; j <= min_level; ++j)
+            buffer_max_size += max_size(j);
+
+        auto initial = std::make_unique<Version>();
+        initial->buffer = std::make_shared<Level>();
+        publish(std::move(initial));
+        if (max_frozen > 0)
+            merger = std::thread(&ConcurrentDynamicPGMIndex::merge_frozen, this);
+    }
+
+    /**
+     * Constructs the container on the sorted data in the range [first, last).
+     * @tparam Iterator
+     * @param first, last the range containing the sorted elements to be indexed
+     * @param base determines the size of the ith level as base^i
+     * @param buffer_level determines the size of level 0, equal to the sum of base^i for i = 0, ..., buffer_level
+     * @param index_level the minimum level at which an index is constructed to speed up searches
+     * @param max_frozen_buffers the maximum number of full buffers waiting for a merge in a background thread before
+     *                           an insertion blocks, or 0 to merge the full buffer in the inserting thread
+     */
+    template<typename Iterator, std::enable_if_t<!std::is_integral_v<Iterator>, int> = 0>
+    ConcurrentDynamicPGMIndex(Iterator first, Iterator last, uint8_t base = 8, uint8_t buffer_level = 0,
+                              uint8_t index_level = 0, uint8_t max_frozen_buffers = 0)
+        : ConcurrentDynamicPGMIndex(base, buffer_level, index_level, max_frozen_buffers) {
+        size_t n = std::distance(first, last);
+        if (n == 0)
+            return;
+
+        // Copy only the first of each group of pairs with same key value
+        auto run = std::make_shared<Run>();
+        auto &items = run->items;
+        items.reserve(n);
+        items.emplace_back(first->first, first->second);
+        while (++first != last) {
+            if (first->first < items.back().first)
+                throw std::invalid_argument("Range is not sorted");
+            if (first->first != items.back().first)
+                items.emplace_back(first->first, first->second);
+        }
+
+        auto target = std::max<uint8_t>(ceil_log_base(n), min_level) + 1;
+        if (target >= min_index_level)
+            run->pgm = PGMType(items.begin(), items.end());
+        std::lock_guard<std::mutex> lock(write_mutex);
+        auto initial = std::make_unique<Version>(current());
+        initial->runs.resize(target - min_level);
+        initial->runs.back() = std::move(run);
+        publish(std::move(initial));
+    }
+
+    ~ConcurrentDynamicPGMIndex() {
+        if (merger.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(write_mutex);
+                stopping = true;
+            }
+            merge_requested.notify_one();
+            merger.join();
+        }
+
+        delete version.load();
+        for (auto &[epoch, old] : retired)
+            delete old;
+    }
+
+    ConcurrentDynamicPGMIndex(const ConcurrentDynamicPGMIndex &) = delete;
+    ConcurrentDynamicPGMIndex &operator=(const ConcurrentDynamicPGMIndex &) = delete;
+
+    /**
+     * Inserts an element into the container if @p key does not exists in the container. If @p key already exists, the
+     * corresponding value is updated with @p value.
+     * @param key element key to insert or update
+     * @param value element value to insert
+     */
+    void insert_or_assign(const K &key, const V &value) { insert(Item(key, value)); }
+
+    /**
+     * Removes the specified element from the container.
+     * @param key key value of the element to remove
+     */
+    void erase(const K &key) { insert(Item(key)); }
+
+    /**
+     * Returns a consistent read-only view of the current content of the container, which is not affected by later
+     * writes. Taking a snapshot copies the references to the levels of the current version, which costs more than a
+     * single query on the container, so it is meant for a batch of queries that must see the same content.
+     * @return a snapshot of the container
+     */
+    Snapshot snapshot() const {
+        return read([&](const Snapshot &current_snapshot) {
+            return Snapshot(std::make_shared<const Version>(*current_snapshot.version), min_level, min_index_level);
+        });
+    }
+
+    /**
+     * Finds the value of the element with key equivalent to @p key.
+     * @param key key value of the element to search for
+     * @return a copy of the value of the element, or an empty optional if no such element is found
+     */
+    std::optional<V> find(const K &key) const { return read([&](const Snapshot &s) { return s.find(key); }); }
+
+    /**
+     * Checks if there is an element with key equivalent to @p key in the container.
+     * @param key key value of the element to search for
+     * @return true if there is such an element, false otherwise
+     */
+    bool contains(const K &key) const { return read([&](const Snapshot &s) { return s.contains(key); }); }
+
+    /**
+     * Returns the first element with key not less than (i.e. greater or equal to) @p key.
+     * @param key key value to compare the elements to
+     * @return a copy of the element, or an empty optional if no such element is found
+     */
+    std::optional<std::pair<K, V>> lower_bound(const K &key) const {
+        return read([&](const Snapshot &s) { return s.lower_bound(key); });
+    }
+
+    /**
+     * Returns a copy of the elements with key between and including @p lo and @p hi.
+     * @param lo lower endpoint of the range query
+     * @param hi upper endpoint of the range query, must be greater than or equal to @p lo
+     * @return a vector of key-value pairs satisfying the range query
+     */
+    std::vector<std::pair<K, V>> range(const K &lo, const K &hi) const {
+        return read([&](const Snapshot &s) { return s.range(lo, hi); });
+    }
+
+    /**
+     * Returns the size of the container (data + index structure) in bytes.
+     * @return the size of the container in bytes
+     */
+    size_t size_in_bytes() const { return read([&](const Snapshot &s) { return s.size_in_bytes(); }); }
+};
+
+/**
+ * A read-only view of a version of a @ref ConcurrentDynamicPGMIndex, which keeps the version alive.
+ */
+template<typename K, typename V, typename PGMType>
+class ConcurrentDynamicPGMIndex<K, V, PGMType>::Snapshot {
+    friend class ConcurrentDynamicPGMIndex;
+
+    std::shared_ptr<const Version> owner; ///< The copy of the version, or nullptr if the container protects it.
+    const Version *version;               ///< The version searched by the queries.
+    uint8_t min_level;
+    uint8_t min_index_level;
+
+    Snapshot(const Version *version, uint8_t min_level, uint8_t min_index_level)
+        : owner(), version(version), min_level(min_level), min_index_level(min_index_level) {}
+
+    Snapshot(std::shared_ptr<const Version> owner, uint8_t min_level, uint8_t min_index_level)
+        : owner(std::move(owner)), version(this->owner.get()), min_level(min_level), min_index_level(min_index_level) {}
+
+    /** Calls f(items, pgm) on the non-empty levels, from the newest to the oldest, until f returns true. */
+    template<typename F>
+    void for_each_level(F f) const {
+        if (!version->buffer->empty() && f(*version->buffer, nullptr))
+            return;
+        for (auto it = version->frozen.rbegin(); it != version->frozen.rend(); ++it)
+            if (f(**it, nullptr))
+                return;
+        for (size_t j = 0; j < version->runs.size(); ++j) {
+            auto &run = version->runs[j];
+            auto has_pgm = min_level + 1 + j >= min_index_level;
+            if (run && !run->items.empty() && f(run->items, has_pgm ? &run->pgm : nullptr))
+                return;
+        }
+    }
+
+    /** Returns the range of @p items that may contain @p key according to @p pgm, if not null. */
+    static auto search(const Level &items, const PGMType *pgm, const K &key) {
+        if (pgm == nullptr)
+            return std::make_pair(items.begin(), items.end());
+        auto range = pgm->search(key);
+        return std::make_pair(items.begin() + range.lo, items.begin() + range.hi);
+    }
+
+public:
+
+    /**
+     * Finds the value of the element with key equivalent to @p key.
+     * @param key key value of the element to search for
+     * @return a copy of the value of the element, or an empty optional if no such element is found
+     */
+    std::optional<V> find(const K &key) const {
+        std::optional<V> result;
+        for_each_level([&](const Level &items, const PGMType *pgm) {
+            auto [first, last] = search(items, pgm, key);
+            auto it = Base::lower_bound_bl(first, last, key);
+            if (it == items.end() || it->first != key)
+                return false;
+            if (!it->deleted())
+                result = it->second;
+            return true;
+        });
+        return result;
+    }
+
+    /**
+     * Checks if there is an element with key equivalent to @p key in the snapshot.
+     * @param key key value of the element to search for
+     * @return true if there is such an element, false otherwise
+     */
+    bool contains(const K &key) const { return find(key).has_value(); }
+
+    /**
+     * Returns the first element with key not less than (i.e. greater or equal to) @p key.
+     * @param key key value to compare the elements to
+     * @return a copy of the element, or an empty optional if no such element is found
+     */
+    std::optional<std::pair<K, V>> lower_bound(const K &key) const {
+        const Item *lb = nullptr;
+        std::set<K> deleted;
+
+        for_each_level([&](const Level &items, const PGMType *pgm) {
+            auto [first, last] = search(items, pgm, key);
+            for (auto it = Base::lower_bound_bl(first, last, key);
+                 it != items.end() && (lb == nullptr || it->first < lb->first); ++it) {
+                if (it->deleted())
+                    deleted.emplace(it->first);
+                else if (deleted.find(it->first) == deleted.end()) {
+                    lb = &*it;
+                    break;
+                }
+            }
+            return lb != nullptr && lb->first == key;
+        });
+
+        if (lb == nullptr)
+            return std::nullopt;
+        return std::make_pair(lb->first, lb->second);
+    }
+
+    /**
+     * Returns a copy of the elements with key between and including @p lo and @p hi.
+     * @param lo lower endpoint of the range query
+     * @param hi upper endpoint of the range query, must be greater than or equal to @p lo
+     * @return a vector of key-value pairs satisfying the range query
+     */
+    std::vector<std::pair<K, V>> range(const K &lo, const K &hi) const {
+        if (lo > hi)
+            throw std::invalid_argument("lo > hi");
+
+        Level tmp_a;
+        Level tmp_b;
+        auto alternate = true;
+
+        for_each_level([&](const Level &items, const PGMType *pgm) {
+            auto [lo_first, lo_last] = search(items, pgm, lo);
+            auto [hi_first, hi_last] = search(items, pgm, hi);
+            auto it_lo = Base::lower_bound_bl(lo_first, lo_last, lo);
+            auto it_hi = std::upper_bound(std::max(it_lo, hi_first), hi_last, hi);
+            auto range_size = std::distance(it_lo, it_hi);
+            if (range_size == 0)
+                return false;
+
+            auto tmp_size = (alternate ? tmp_a : tmp_b).size();
+            (alternate ? tmp_b : tmp_a).resize(tmp_size + range_size);
+            auto tmp_it = (alternate ? tmp_a : tmp_b).begin();
+            auto out_it = (alternate ? tmp_b : tmp_a).begin();
+            tmp_size = std::distance(out_it, Base::template merge<false, false>(tmp_it, tmp_it + tmp_size, it_lo, it_hi,
+                                                                                out_it));
+            (alternate ? tmp_b : tmp_a).resize(tmp_size);
+            alternate = !alternate;
+            return false;
+        });
+
+        std::vector<std::pair<K, V>> result;
+        result.reserve((alternate ? tmp_a : tmp_b).size());
+        for (auto &item : alternate ? tmp_a : tmp_b)
+            if (!item.deleted())
+                result.emplace_back(item.first, item.second);
+        return result;
+    }
+
+    /**
+     * Returns the size of the snapshot (data + index structure) in bytes.
+     * @return the size of the snapshot in bytes
+     */
+    size_t size_in_bytes() const {
+        auto bytes = sizeof(Version) + version->buffer->size() * sizeof(Item);
+        for (auto &buffer : version->frozen)
+            bytes += buffer->size() * sizeof(Item);
+        for (auto &run : version->runs)
+            if (run)
+                bytes += sizeof(Run) + run->items.size() * sizeof(Item) + run->pgm.size_in_bytes();
+        return bytes;
+    }
+};
+
 }
\ No newline at end of file
@@ -15,12 +15,14 @@
 
 #pragma once
 
+#include "key_traits.hpp"
 #include "morton_nd.hpp"
 #include "piecewise_linear_model.hpp"
 #include "pgm_index.hpp"
 #include "sdsl.hpp"
 
 #include <fcntl.h>
+#include <unistd.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <algorithm>
@@ -128,7 +130,7 @@ public:
         while (EpsilonRecursive && last_n > 1) {
             auto offset = levels_offsets[levels_offsets.size() - 2];
             auto in_fun_rec = [&](auto i) { return std::pair<K, size_t>(segments[offset + i].get_first_x(), i); };
-            last_n = internal::make_segmentation(last_n, EpsilonRecursive, in_fun_rec, out_fun);
+            last_n = internal::make_segmentation_par(last_n, EpsilonRecursive, in_fun_rec, out_fun);
             levels_offsets.push_back(levels_offsets.back() + last_n);
         }
 
@@ -378,8 +380,8 @@ protected:
     size_t n;                                     ///< The number of elements this index was built on.
     K first_key;                                  ///< The smallest element.
     K last_key;                                   ///< The largest element.
-    std::vector<Segment> segments;                ///< The segments composing the index.
-    sdsl::int_vector<TopLevelBitSize> top_level;  ///< The structure on the segment.
+    std::vector<Segment, AlignedAllocator<Segment>> segments; ///< The segments composing the index.
+    sdsl::int_vector<TopLevelBitSize> top_level;              ///< The structure on the segment.
     K step;
 
     void build_top_level() {
@@ -438,25 +440,1600 @@ public:
     /**
      * Constructs the index on the given sorted vector.
      * @param data the vector of keys, must be sorted
+     * @param policy the kind of memory pages that back the segments of the index
      */
-    BucketingPGMIndex(const std::vector<K> &data) : BucketingPGMIndex(data.begin(), data.end()) {}
+    BucketingPGMIndex(const std::vector<K> &data, PagePolicy policy = PagePolicy::Regular)
+        : BucketingPGMIndex(data.begin(), data.end(), policy) {}
 
     /**
      * Constructs the index on the sorted keys in the range [first, last).
      * @param first, last the range containing the sorted keys to be indexed
+     * @param policy the kind of memory pages that back the segments of the index
      */
     template<typename RandomIt>
-    BucketingPGMIndex(RandomIt first, RandomIt last)
+    BucketingPGMIndex(RandomIt first, RandomIt last, PagePolicy policy = PagePolicy::Regular)
         : n(std::distance(first, last)),
           first_key(n ? *first : K(0)),
           last_key(n ? *(last - 1) : K(0)),
+          segments(AlignedAllocator<Segment>(policy)),
+          top_level() {
+        if (n == 0)
+            return;
+        std::vector<size_t> offsets;
+        PGMIndex<K, Epsilon, 0, Floating>::build(first, last, Epsilon, 0, segments, offsets);
+        build_top_level();
+    }
+
+    /**
+     * Returns the approximate position and the range where @p key can be found.
+     * @param key the value of the element to search for
+     * @return a struct with the approximate position and bounds of the range
+     */
+    ApproxPos search(const K &key) const {
+        if (__builtin_expect(key < first_key, 0))
+            return {0, 0, 0};
+        if (__builtin_expect(key > last_key, 0))
+            return {n, n, n};
+        auto it = segment_for_key(key);
+        auto pos = std::min<size_t>((*it)(key), std::next(it)->intercept);
+        auto lo = PGM_SUB_EPS(pos, Epsilon);
+        auto hi = PGM_ADD_EPS(pos, Epsilon, n);
+        return {pos, lo, hi};
+    }
+
+    /**
+     * Returns the number of segments in the last level of the index.
+     * @return the number of segments
+     */
+    size_t segments_count() const {
+        return segments.size();
+    }
+
+    /**
+     * Returns the number of levels of the index.
+     * @return the number of levels of the index
+     */
+    size_t height() const {
+        return 1;
+    }
+
+    /**
+     * Returns the size of the index in bytes.
+     * @return the size of the index in bytes
+     */
+    size_t size_in_bytes() const {
+        return segments.size() * sizeof(Segment) + top_level.size() * top_level.width() / CHAR_BIT;
+    }
+};
+
+/**
+ * A variant of @ref OneLevelPGMIndex that builds a top-level succinct structure to speed up the search on the
+ * segments.
+ *
+ * @tparam K the type of the indexed keys
+ * @tparam Epsilon controls the size of the returned search range
+ * @tparam Floating the floating-point type to use for slopes
+ */
+template<typename K, size_t Epsilon = 64, typename Floating = float>
+class EliasFanoPGMIndex {
+protected:
+    static_assert(Epsilon > 0);
+
+    using Segment = typename PGMIndex<K, Epsilon, 0, Floating>::Segment;
+
+    struct SegmentData {
+        Floating slope;    ///< The slope of the segment.
+        int32_t intercept; ///< The intercept of the segment.
+
+        SegmentData() = default;
+
+        SegmentData(Segment &s) : slope(s.slope), intercept(s.intercept) {}
+
+        inline size_t operator()(const K &origin, const K &k) const {
+            auto pos = int64_t(slope * (k - origin)) + intercept;
+            return pos > 0 ? size_t(pos) : 0ull;
+        }
+    };
+
+    size_t n;                           ///< The number of elements this index was built on.
+    K first_key;                        ///< The smallest segment key.
+    std::vector<SegmentData> segments;  ///< The segments composing the index.
+    sdsl::sd_vector<> ef;               ///< The Elias-Fano structure on the segment.
+
+public:
+
+    static constexpr size_t epsilon_value = Epsilon;
+
+    /**
+     * Constructs an empty index.
+     */
+    EliasFanoPGMIndex() = default;
+
+    /**
+     * Constructs the index on the given sorted vector.
+     * @param data the vector of keys, must be sorted
+     */
+    explicit EliasFanoPGMIndex(const std::vector<K> &data) : EliasFanoPGMIndex(data.begin(), data.end()) {}
+
+    /**
+     * Constructs the index on the sorted keys in the range [first, last).
+     * @param first, last the range containing the sorted keys to be indexed
+     */
+    template<typename RandomIt>
+    EliasFanoPGMIndex(RandomIt first, RandomIt last)
+        : n(std::distance(first, last)),
+          first_key(n ? *first : K(0)),
+          segments(),
+          ef() {
+        if (n == 0)
+            return;
+
+        std::vector<Segment> tmp;
+        std::vector<size_t> offsets;
+        PGMIndex<K, Epsilon, 0, Floating>::build(first, last, Epsilon, 0, tmp, offsets);
+
+        segments.reserve(tmp.size());
+        for (auto &x: tmp) {
+            segments.push_back(x);
+            x.key -= first_key;
+        }
+
+        ef = decltype(ef)(tmp.begin(), std::prev(tmp.end()));
+    }
+
+    /**
+     * Returns the approximate position and the range where @p key can be found.
+     * @param key the value of the element to search for
+     * @return a struct with the approximate position and bounds of the range
+     */
+    ApproxPos search(const K &key) const {
+        auto k = std::max(first_key, key);
+        auto[r, origin] = pred(k - first_key);
+        auto pos = std::min<size_t>(segments[r](origin + first_key, k), segments[r + 1].intercept);
+        auto lo = PGM_SUB_EPS(pos, Epsilon);
+        auto hi = PGM_ADD_EPS(pos, Epsilon, n);
+        return {pos, lo, hi};
+    }
+
+    /**
+     * Returns the number of segments in the last level of the index.
+     * @return the number of segments
+     */
+    size_t segments_count() const {
+        return segments.size();
+    }
+
+    /**
+     * Returns the number of levels of the index.
+     * @return the number of levels of the index
+     */
+    size_t height() const {
+        return 1;
+    }
+
+    /**
+     * Returns the size of the index in bytes.
+     * @return the size of the index in bytes
+     */
+    size_t size_in_bytes() const {
+        return segments.size() * sizeof(SegmentData) + sdsl::size_in_bytes(ef);
+    }
+
+private:
+
+    std::pair<size_t, uint64_t> pred(uint64_t i) const {
+        if (i > ef.size()) {
+            auto j = ef.low.size();
+            return {j - 1, ef.low[j - 1] + ((ef.high_1_select(j) + 1 - j) << (ef.wl))};
+        }
+        ++i;
+
+        auto high_val = (i >> (ef.wl));
+        auto sel_high = ef.high_0_select(high_val + 1);
+        auto rank_low = sel_high - high_val;
+        if (0 == rank_low)
+            return {0, ef.low[0] + (high_val << ef.wl)};
+
+        auto val_low = i & sdsl::bits::lo_set[ef.wl];
+        do {
+            if (!sel_high)
+                return {0, ef.low[rank_low] + (high_val < ef.wl)};
+            --sel_high;
+            --rank_low;
+        } while (ef.high[sel_high] and ef.low[rank_low] >= val_low);
+        auto h = ef.high[sel_high] ? high_val : sdsl::bits::prev(ef.high.data(), sel_high) - rank_low;
+        return {rank_low, ef.low[rank_low] + (h << ef.wl)};
+    }
+};
+
+/**
+ * A variant of @ref PGMIndex that stores the keys, slopes and intercepts of the segments in separate arrays.
+ *
+ * The search in the recursive levels compares only the keys of the segments, thus this layout packs more of them in
+ * a cache line and allows scanning them with SIMD instructions, at the cost of one more cache miss per level to read
+ * the slope and the intercept of the chosen segment.
+ *
+ * @tparam K the type of the indexed keys
+ * @tparam Epsilon controls the size of the returned search range
+ * @tparam EpsilonRecursive controls the size of the search range in the internal structure
+ * @tparam Floating the floating-point type to use for slopes
+ */
+template<typename K, size_t Epsilon = 64, size_t EpsilonRecursive = 4, typename Floating = float>
+class SoAPGMIndex {
+protected:
+    static_assert(Epsilon > 0);
+
+    using Segment = typename PGMIndex<K, Epsilon, EpsilonRecursive, Floating>::Segment;
+    using Intercept = decltype(Segment::intercept);
+
+    size_t n;                                                       ///< The number of elements this index was built on.
+    K first_key;                                                    ///< The smallest element.
+    std::vector<K, AlignedAllocator<K>> keys;                       ///< The first key that each segment indexes.
+    std::vector<Floating, AlignedAllocator<Floating>> slopes;       ///< The slope of each segment.
+    std::vector<Intercept, AlignedAllocator<Intercept>> intercepts; ///< The intercept of each segment.
+    std::vector<size_t> levels_offsets; ///< The starting position of each level in the arrays, in reverse order.
+
+    /**
+     * Returns the approximate position of the specified key according to the segment at index @p i.
+     * @param i the index of the segment
+     * @param k the key whose position must be approximated
+     * @return the approximate position of the specified key
+     */
+    size_t approximate(size_t i, const K &k) const {
+        auto pos = int64_t(slopes[i] * (k - keys[i])) + intercepts[i];
+        return pos > 0 ? size_t(pos) : 0ull;
+    }
+
+    /**
+     * Returns the segment responsible for a given key, that is, the rightmost segment having key <= the sought key.
+     * @param key the value of the element to search for
+     * @return the index of the segment responsible for the given key
+     */
+    size_t segment_for_key(const K &key) const {
+        if constexpr (EpsilonRecursive == 0)
+            return std::upper_bound(keys.begin(), keys.begin() + segments_count(), key) - keys.begin() - 1;
+
+        auto i = *(levels_offsets.end() - 2);
+        for (auto l = int(height()) - 2; l >= 0; --l) {
+            auto level_begin = levels_offsets[l];
+            auto level_size = levels_offsets[l + 1] - levels_offsets[l] - 1;
+            auto pos = std::min<size_t>(approximate(i, key), intercepts[i + 1]);
+            auto lo = level_begin + PGM_SUB_EPS(pos, EpsilonRecursive + 1);
+            auto hi = level_begin + PGM_ADD_EPS(pos, EpsilonRecursive, level_size);
+
+            static constexpr size_t linear_search_threshold = 8 * 64 / sizeof(K);
+            if constexpr (EpsilonRecursive <= linear_search_threshold) {
+                if constexpr (internal::simd_rank_supported<K>)
+                    i = lo + internal::simd_rank<true>(keys.data() + lo, hi - lo, key) - 1;
+                else
+                    i = lo + internal::scalar_rank<true>(keys.data() + lo, hi - lo, key) - 1;
+            } else
+                i = std::upper_bound(keys.begin() + lo, keys.begin() + hi, key) - keys.begin() - 1;
+        }
+        return i;
+    }
+
+public:
+
+    static constexpr size_t epsilon_value = Epsilon;
+
+    /**
+     * Constructs an empty index.
+     */
+    SoAPGMIndex() = default;
+
+    /**
+     * Constructs the index on the given sorted vector.
+     * @param data the vector of keys to be indexed, must be sorted
+     * @param policy the kind of memory pages that back the segments of the index
+     */
+    explicit SoAPGMIndex(const std::vector<K> &data, PagePolicy policy = PagePolicy::Regular)
+        : SoAPGMIndex(data.begin(), data.end(), policy) {}
+
+    /**
+     * Constructs the index on the sorted keys in the range [first, last).
+     * @param first, last the range containing the sorted keys to be indexed
+     * @param policy the kind of memory pages that back the segments of the index
+     */
+    template<typename RandomIt>
+    SoAPGMIndex(RandomIt first, RandomIt last, PagePolicy policy = PagePolicy::Regular)
+        : n(std::distance(first, last)),
+          first_key(n ? *first : K(0)),
+          keys(AlignedAllocator<K>(policy)),
+          slopes(AlignedAllocator<Floating>(policy)),
+          intercepts(AlignedAllocator<Intercept>(policy)),
+          levels_offsets() {
+        std::vector<Segment> segments;
+        PGMIndex<K, Epsilon, EpsilonRecursive, Floating>::build(first, last, Epsilon, EpsilonRecursive,
+                                                                segments, levels_offsets);
+        keys.reserve(segments.size());
+        slopes.reserve(segments.size());
+        intercepts.reserve(segments.size());
+        for (auto &s : segments) {
+            keys.push_back(s.key);
+            slopes.push_back(s.slope);
+            intercepts.push_back(s.intercept);
+        }
+    }
+
+    /**
+     * Returns the approximate position and the range where @p key can be found.
+     * @param key the value of the element to search for
+     * @return a struct with the approximate position and bounds of the range
+     */
+    ApproxPos search(const K &key) const {
+        auto k = std::max(first_key, key);
+        auto i = segment_for_key(k);
+        auto pos = std::min<size_t>(approximate(i, k), intercepts[i + 1]);
+        auto lo = PGM_SUB_EPS(pos, Epsilon);
+        auto hi = PGM_ADD_EPS(pos, Epsilon, n);
+        return {pos, lo, hi};
+    }
+
+    /**
+     * Returns the number of segments in the last level of the index.
+     * @return the number of segments
+     */
+    size_t segments_count() const { return keys.empty() ? 0 : levels_offsets[1] - 1; }
+
+    /**
+     * Returns the number of levels of the index.
+     * @return the number of levels of the index
+     */
+    size_t height() const { return levels_offsets.size() - 1; }
+
+    /**
+     * Returns the size of the index in bytes.
+     * @return the size of the index in bytes
+     */
+    size_t size_in_bytes() const {
+        return keys.size() * (sizeof(K) + sizeof(Floating) + sizeof(Intercept))
+            + levels_offsets.size() * sizeof(size_t);
+    }
+};
+
+/**
+ * A variant of @ref PGMIndex that replaces the recursive levels with a static B+-tree on the keys of the segments.
+ *
+ * Each node of the tree fills a cache line with the keys that separate its children, and the nodes of each level are
+ * stored contiguously from the root downwards. Thus, a root-to-leaf walk costs one cache miss per level and scans each
+ * node without branches. The segments are stored as in @ref OneLevelPGMIndex, next to each other in key order.
+ *
+ * @tparam K the type of the indexed keys
+ * @tparam Epsilon controls the size of the returned search range
+ * @tparam Floating the floating-point type to use for slopes
+ */
+template<typename K, size_t Epsilon = 64, typename Floating = float>
+class BTreePGMIndex {
+protected:
+    static_assert(Epsilon > 0);
+
+    using Segment = typename PGMIndex<K, Epsilon, 0, Floating>::Segment;
+
+    static constexpr size_t node_size = std::max<size_t>(64 / sizeof(K), 2); ///< The number of keys in a node.
+    static constexpr size_t fanout = node_size + 1;                          ///< The number of children of a node.
+
+    size_t n;                                                 ///< The number of elements this index was built on.
+    K first_key;                                              ///< The smallest element.
+    std::vector<Segment, AlignedAllocator<Segment>> segments; ///< The segments composing the index.
+    std::vector<K, AlignedAllocator<K>> tree;                 ///< The nodes of the B+-tree, level by level.
+    std::vector<size_t> levels_offsets;                       ///< The starting position of each level in tree[].
+
+    /**
+     * Returns the number of keys in the node at the given position that are less than or equal to @p key.
+     * @param node a pointer to the keys of the node
+     * @param key the value of the element to search for
+     * @return the index of the child of the node where the search should continue
+     */
+    static size_t rank_in_node(const K *node, const K &key) {
+        if constexpr (internal::simd_rank_supported<K>)
+            return internal::simd_rank<true>(node, node_size, key);
+        else
+            return internal::scalar_rank<true>(node, node_size, key);
+    }
+
+    void build_tree() {
+        auto m = segments_count();
+        auto blocks = CEIL_INT_DIV(m, node_size);
+
+        // The i-th key of a node is the smallest segment key in the subtree of the (i+1)-th child of the node
+        std::vector<size_t> levels_sizes;
+        for (auto size = blocks; size > 1;) {
+            size = CEIL_INT_DIV(size, fanout);
+            levels_sizes.push_back(size);
+        }
+
+        levels_offsets.assign(levels_sizes.size() + 1, 0);
+        for (size_t h = levels_sizes.size(); h > 0; --h)
+            levels_offsets[h - 1] = levels_offsets[h] + levels_sizes[h - 1] * node_size;
+        tree.assign(levels_offsets[0], std::numeric_limits<K>::max());
+
+        size_t blocks_per_child = 1;
+        for (size_t h = 0; h < levels_sizes.size(); ++h, blocks_per_child *= fanout) {
+            for (size_t c = 0; c < levels_sizes[h]; ++c) {
+                for (size_t i = 0; i < node_size; ++i) {
+                    auto first_segment = ((c * fanout + i + 1) * blocks_per_child) * node_size;
+                    if (first_segment < m)
+                        tree[levels_offsets[h + 1] + c * node_size + i] = segments[first_segment].key;
+                }
+            }
+        }
+    }
+
+    /**
+     * Returns the segment responsible for a given key, that is, the rightmost segment having key <= the sought key.
+     * @param key the value of the element to search for
+     * @return an iterator to the segment responsible for the given key
+     */
+    auto segment_for_key(const K &key) const {
+        size_t c = 0;
+        for (auto h = levels_offsets.size() - 1; h > 0; --h) {
+            c = c * fanout + rank_in_node(tree.data() + levels_offsets[h] + c * node_size, key);
+            if (h > 1) // The padding keys equal the maximum of K, so they may lead past the last node of the next level
+                c = std::min(c, (levels_offsets[h - 2] - levels_offsets[h - 1]) / node_size - 1);
+        }
+
+        auto m = segments_count();
+        auto first = std::min(c * node_size, m - 1);
+        auto last = std::min(first + node_size, m);
+        size_t count = 0;
+        for (auto i = first; i < last; ++i)
+            count += segments[i].key <= key;
+        return segments.begin() + first + std::max<size_t>(count, 1) - 1;
+    }
+
+public:
+
+    static constexpr size_t epsilon_value = Epsilon;
+
+    /**
+     * Constructs an empty index.
+     */
+    BTreePGMIndex() = default;
+
+    /**
+     * Constructs the index on the given sorted vector.
+     * @param data the vector of keys to be indexed, must be sorted
+     * @param policy the kind of memory pages that back the segments of the index
+     */
+    explicit BTreePGMIndex(const std::vector<K> &data, PagePolicy policy = PagePolicy::Regular)
+        : BTreePGMIndex(data.begin(), data.end(), policy) {}
+
+    /**
+     * Constructs the index on the sorted keys in the range [first, last).
+     * @param first, last the range containing the sorted keys to be indexed
+     * @param policy the kind of memory pages that back the segments of the index
+     */
+    template<typename RandomIt>
+    BTreePGMIndex(RandomIt first, RandomIt last, PagePolicy policy = PagePolicy::Regular)
+        : n(std::distance(first, last)),
+          first_key(n ? *first : K(0)),
+          segments(AlignedAllocator<Segment>(policy)),
+          tree(AlignedAllocator<K>(policy)),
+          levels_offsets() {
+        if (n == 0)
+            return;
+        std::vector<size_t> offsets;
+        PGMIndex<K, Epsilon, 0, Floating>::build(first, last, Epsilon, 0, segments, offsets);
+        build_tree();
+    }
+
+    /**
+     * Returns the approximate position and the range where @p key can be found.
+     * @param key the value of the element to search for
+     * @return a struct with the approximate position and bounds of the range
+     */
+    ApproxPos search(const K &key) const {
+        auto k = std::max(first_key, key);
+        auto it = segment_for_key(k);
+        auto next = std::next(it);
+        // Only max() reaches the key of the sentinel, whose position is known and may overflow the segment function
+        auto pos = k < next->key ? std::min<size_t>((*it)(k), next->intercept) : next->intercept;
+        auto lo = PGM_SUB_EPS(pos, Epsilon);
+        auto hi = PGM_ADD_EPS(pos, Epsilon, n);
+        return {pos, lo, hi};
+    }
+
+    /**
+     * Returns the number of segments in the last level of the index.
+     * @return the number of segments
+     */
+    size_t segments_count() const { return segments.empty() ? 0 : segments.size() - 1; }
+
+    /**
+     * Returns the number of levels of the index, counting the segments and the levels of the B+-tree.
+     * @return the number of levels of the index
+     */
+    size_t height() const { return levels_offsets.size(); }
+
+    /**
+     * Returns the size of the index in bytes.
+     * @return the size of the index in bytes
+     */
+    size_t size_in_bytes() const {
+        return segments.size() * sizeof(Segment) + tree.size() * sizeof(K) + levels_offsets.size() * sizeof(size_t);
+    }
+};
+
+/**
+ * A read-only view of a built @ref PGMIndex whose number of levels is fixed at compile time.
+ *
+ * The search descends the levels with a fully unrolled sequence of steps, each using the precomputed start and size of
+ * its level, so it avoids the loop over the levels and the reads of their offsets of @ref PGMIndex::search. The view
+ * must not outlive the index it was created from. Use @ref visit_fixed_height to pick the view matching an index.
+ *
+ * @tparam K the type of the indexed keys
+ * @tparam Epsilon controls the size of the returned search range
+ * @tparam EpsilonRecursive controls the size of the search range in the internal structure
+ * @tparam Floating the floating-point type to use for slopes
+ * @tparam Height the number of levels of the index
+ * @tparam Intercept the signed integer type to use for intercepts
+ */
+template<typename K, size_t Epsilon, size_t EpsilonRecursive, typename Floating, size_t Height,
+         typename Intercept = int32_t>
+class FixedHeightPGMIndex {
+protected:
+    static_assert(Height > 0);
+
+    using Index = PGMIndex<K, Epsilon, EpsilonRecursive, Floating, Intercept>;
+    using Segment = typename Index::Segment;
+
+    size_t n;                      ///< The number of elements the index was built on.
+    K first_key;                   ///< The smallest element.
+    const Segment *levels[Height]; ///< The first segment of each level, from the bottom one.
+    size_t levels_sizes[Height];   ///< The number of segments in each level, excluding the sentinel.
+    size_t bytes;                  ///< The size of the index in bytes.
+
+    /**
+     * Returns the segment responsible for a given key in the given level, given the segment responsible for it in the
+     * level above.
+     * @param it the segment responsible for the key in the level above
+     * @param key the value of the element to search for
+     * @return the segment responsible for the given key in the bottom level
+     */
+    template<size_t Level>
+    const Segment *segment_for_key(const Segment *it, const K &key) const {
+        auto pos = std::min<size_t>((*it)(key), std::next(it)->intercept);
+        auto lo = levels[Level] + PGM_SUB_EPS(pos, EpsilonRecursive + 1);
+
+        static constexpr size_t linear_search_threshold = 8 * 64 / sizeof(Segment);
+        if constexpr (EpsilonRecursive <= linear_search_threshold) {
+            for (; std::next(lo)->key <= key; ++lo)
+                continue;
+            it = lo;
+        } else {
+            auto hi = levels[Level] + PGM_ADD_EPS(pos, EpsilonRecursive, levels_sizes[Level]);
+            it = std::prev(std::upper_bound(lo, hi, key));
+        }
+
+        if constexpr (Level == 0)
+            return it;
+        else
+            return segment_for_key<Level - 1>(it, key);
+    }
+
+public:
+
+    static constexpr size_t epsilon_value = Epsilon;
+
+    /**
+     * Constructs the view of the given index.
+     * @param index the index, whose height must be equal to @p Height
+     */
+    explicit FixedHeightPGMIndex(const Index &index)
+        : n(index.n),
+          first_key(index.first_key),
+          levels(),
+          levels_sizes(),
+          bytes(index.size_in_bytes()) {
+        if (index.segments.empty() || index.height() != Height)
+            throw std::invalid_argument("The index must have height " + std::to_string(Height));
+        for (size_t l = 0; l < Height; ++l) {
+            levels[l] = index.segments.data() + index.levels_offsets[l];
+            levels_sizes[l] = index.levels_offsets[l + 1] - index.levels_offsets[l] - 1;
+        }
+    }
+
+    /**
+     * Returns the approximate position and the range where @p key can be found.
+     * @param key the value of the element to search for
+     * @return a struct with the approximate position and bounds of the range
+     */
+    ApproxPos search(const K &key) const {
+        auto k = std::max(first_key, key);
+        const Segment *it;
+        if constexpr (Height == 1)
+            it = std::prev(std::upper_bound(levels[0], levels[0] + levels_sizes[0], k));
+        else
+            it = segment_for_key<Height - 2>(levels[Height - 1], k);
+        auto pos = std::min<size_t>((*it)(k), std::next(it)->intercept);
+        auto lo = PGM_SUB_EPS(pos, Epsilon);
+        auto hi = PGM_ADD_EPS(pos, Epsilon, n);
+        return {pos, lo, hi};
+    }
+
+    /**
+     * Returns the number of segments in the last level of the index.
+     * @return the number of segments
+     */
+    size_t segments_count() const { return levels_sizes[0]; }
+
+    /**
+     * Returns the number of levels of the index.
+     * @return the number of levels of the index
+     */
+    static constexpr size_t height() { return Height; }
+
+    /**
+     * Returns the size of the viewed index in bytes.
+     * @return the size of the index in bytes
+     */
+    size_t size_in_bytes() const { return bytes; }
+};
+
+/**
+ * Calls @p visitor with a @ref FixedHeightPGMIndex view of the given index, if its height is at most 6, otherwise with
+ * the index itself. Thus, the height is dispatched once rather than at every search.
+ * @param index a built index
+ * @param visitor a callable accepting an object with the search interface of @ref PGMIndex
+ * @return the value returned by @p visitor
+ */
+template<typename K, size_t Epsilon, size_t EpsilonRecursive, typename Floating, typename Intercept, typename Visitor>
+decltype(auto) visit_fixed_height(const PGMIndex<K, Epsilon, EpsilonRecursive, Floating, Intercept> &index,
+                                  Visitor &&visitor) {
+    using Index = PGMIndex<K, Epsilon, EpsilonRecursive, Floating, Intercept>;
+    switch (index.segments_count() ? index.height() : 0) {
+        case 1: return visitor(FixedHeightPGMIndex<K, Epsilon, EpsilonRecursive, Floating, 1, Intercept>(index));
+        case 2: return visitor(FixedHeightPGMIndex<K, Epsilon, EpsilonRecursive, Floating, 2, Intercept>(index));
+        case 3: return visitor(FixedHeightPGMIndex<K, Epsilon, EpsilonRecursive, Floating, 3, Intercept>(index));
+        case 4: return visitor(FixedHeightPGMIndex<K, Epsilon, EpsilonRecursive, Floating, 4, Intercept>(index));
+        case 5: return visitor(FixedHeightPGMIndex<K, Epsilon, EpsilonRecursive, Floating, 5, Intercept>(index));
+        case 6: return visitor(FixedHeightPGMIndex<K, Epsilon, EpsilonRecursive, Floating, 6, Intercept>(index));
+        default: return visitor(static_cast<const Index &>(index));
+    }
+}
+
+/**
+ * A container of keys that arrive in increasing order, such as timestamps, with an index that is extended in place at
+ * each append rather than rebuilt.
+ *
+ * Every level of the index keeps the model of its last segment open. An appended key is added to the open segment of
+ * the bottom level, and only when it does not fit a new segment is opened, whose first key is appended in the same way
+ * to the level above. A new level is added when the top one grows beyond a few segments. Thus, appends take amortized
+ * constant time and never trigger a rebuild.
+ *
+ * @tparam K the type of the indexed keys
+ * @tparam Epsilon controls the size of the returned search range
+ * @tparam EpsilonRecursive controls the size of the search range in the internal structure
+ * @tparam Floating the floating-point type to use for slopes
+ */
+template<typename K, size_t Epsilon = 64, size_t EpsilonRecursive = 4, typename Floating = float>
+class AppendOnlyPGMIndex {
+protected:
+    static_assert(Epsilon > 0);
+    static constexpr size_t max_top_level_size = 2 * EpsilonRecursive + 4;
+
+    struct Segment {
+        K key;             ///< The first key that the segment indexes.
+        Floating slope;    ///< The slope of the segment.
+        int64_t intercept; ///< The intercept of the segment.
+
+        size_t operator()(const K &k) const {
+            auto pos = int64_t(slope * (k - key)) + intercept;
+            return pos > 0 ? size_t(pos) : 0ull;
+        }
+    };
+
+    struct Level {
+        std::vector<Segment> segments;                         ///< The segments, the last of which is open.
+        internal::OptimalPiecewiseLinearModel<K, size_t> opt; ///< The model of the open segment.
+
+        explicit Level(size_t epsilon) : segments(), opt(epsilon) {}
+
+        /** Updates the slope and intercept of the open segment to the points added so far. */
+        void refresh() {
+            auto cs = opt.get_segment();
+            auto [cs_slope, cs_intercept] = cs.get_floating_point_segment(segments.back().key);
+            segments.back().slope = cs_slope;
+            segments.back().intercept = int64_t(cs_intercept);
+        }
+    };
+
+    std::vector<K> data;       ///< The keys, in increasing order.
+    std::vector<Level> levels; ///< The levels of the index, from the bottom one.
+
+    /** Adds the point (x, y) to the given level, and the first key of any segment it opens to the level above. */
+    void add_point(size_t l, const K &x, size_t y) {
+        auto &level = levels[l];
+        if (!level.segments.empty() && level.opt.add_point(x, y)) {
+            level.refresh();
+            return;
+        }
+
+        if (!level.segments.empty())
+            level.refresh(); // The model still describes the segment that has just been closed
+        level.opt.add_point(x, y);
+        level.segments.push_back({x, 0, int64_t(y)});
+        auto j = level.segments.size() - 1;
+
+        if (l + 1 < levels.size()) {
+            add_point(l + 1, x, j);
+        } else if (EpsilonRecursive > 0 && level.segments.size() > max_top_level_size) {
+            levels.emplace_back(EpsilonRecursive);
+            for (size_t i = 0; i <= j; ++i)
+                add_point(l + 1, levels[l].segments[i].key, i);
+        }
+    }
+
+    /** Returns the approximate position in the level below of @p k, given the segment j responsible for it. */
+    static size_t predict(const std::vector<Segment> &segments, size_t j, const K &k, size_t size_below) {
+        auto limit = j + 1 < segments.size() ? size_t(std::max<int64_t>(0, segments[j + 1].intercept)) : size_below;
+        return std::min(segments[j](k), limit);
+    }
+
+public:
+
+    static constexpr size_t epsilon_value = Epsilon;
+
+    /**
+     * Constructs an empty container.
+     */
+    AppendOnlyPGMIndex() : data(), levels() { levels.emplace_back(Epsilon); }
+
+    /**
+     * Constructs the container on the given increasing keys.
+     * @param first, last the range containing the keys, which must be strictly increasing
+     */
+    template<typename InputIt>
+    AppendOnlyPGMIndex(InputIt first, InputIt last) : AppendOnlyPGMIndex() { append(first, last); }
+
+    /**
+     * Appends a key to the container.
+     * @param key the key to append, which must be greater than the last key in the container
+     */
+    void push_back(const K &key) {
+        if (!data.empty() && !(data.back() < key))
+            throw std::invalid_argument("The keys must be appended in strictly increasing order");
+        data.push_back(key);
+        add_point(0, key, data.size() - 1);
+    }
+
+    /**
+     * Appends the keys in the range [first, last) to the container.
+     * @param first, last the range containing the keys, which must be strictly increasing and greater than the last
+     * key in the container
+     */
+    template<typename InputIt>
+    void append(InputIt first, InputIt last) {
+        for (; first != last; ++first)
+            push_back(*first);
+    }
+
+    /**
+     * Returns the approximate position and the range where @p key can be found.
+     * @param key the value of the element to search for
+     * @return a struct with the approximate position and bounds of the range
+     */
+    ApproxPos search(const K &key) const {
+        auto n = data.size();
+        if (n == 0 || key > data.back())
+            return {n, n, n};
+
+        auto k = std::max(data.front(), key);
+        auto &top = levels.back().segments;
+        auto it = std::upper_bound(top.begin(), top.end(), k, [](const K &x, const Segment &s) { return x < s.key; });
+        size_t j = std::distance(top.begin(), it) - 1;
+
+        for (auto l = levels.size() - 1; l > 0; --l) {
+            auto &below = levels[l - 1].segments;
+            auto pos = predict(levels[l].segments, j, k, below.size());
+            auto lo = PGM_SUB_EPS(pos, EpsilonRecursive + 1);
+            for (; lo + 1 < below.size() && below[lo + 1].key <= k; ++lo)
+                continue;
+            j = lo;
+        }
+
+        auto pos = predict(levels[0].segments, j, k, n);
+        auto lo = PGM_SUB_EPS(pos, Epsilon);
+        auto hi = PGM_ADD_EPS(pos, Epsilon, n);
+        return {pos, lo, hi};
+    }
+
+    /**
+     * Returns an iterator pointing to the first element that is not less than (i.e. greater or equal to) @p key.
+     * @param key value to compare the elements to
+     * @return iterator to the first element that is not less than @p key, or @ref end() if no such element is found
+     */
+    auto lower_bound(const K &key) const {
+        auto range = search(key);
+        return internal::lower_bound_in_range<Epsilon>(data.begin() + range.lo, data.begin() + range.hi, key);
+    }
+
+    /**
+     * Returns an iterator pointing to the first element that is greater than @p key.
+     * @param key value to compare the elements to
+     * @return iterator to the first element that is greater than @p key, or @ref end() if no such element is found
+     */
+    auto upper_bound(const K &key) const {
+        auto it = lower_bound(key);
+        return it != end() && *it == key ? std::next(it) : it;
+    }
+
+    /**
+     * Returns an iterator to the element equal to @p key.
+     * @param key the value of the element to search for
+     * @return an iterator to the element equal to @p key, or @ref end() if no such element is found
+     */
+    auto find(const K &key) const {
+        auto it = lower_bound(key);
+        return it != end() && *it == key ? it : end();
+    }
+
+    /**
+     * Checks if there is an element equal to @p key in the container.
+     * @param key the value of the element to search for
+     * @return @c true if there is such an element, otherwise @c false
+     */
+    bool contains(const K &key) const { return find(key) != end(); }
+
+    /**
+     * Returns an iterator to the first element of the container.
+     * @return an iterator to the first element of the container
+     */
+    auto begin() const { return data.cbegin(); }
+
+    /**
+     * Returns an iterator to the element following the last element of the container.
+     * @return an iterator to the element following the last element of the container
+     */
+    auto end() const { return data.cend(); }
+
+    /**
+     * Returns the number of elements in the container.
+     * @return the number of elements in the container
+     */
+    size_t size() const { return data.size(); }
+
+    /**
+     * Checks if the container has no elements.
+     * @return @c true if the container is empty, otherwise @c false
+     */
+    bool empty() const { return data.empty(); }
+
+    /**
+     * Returns the number of segments in the last level of the index.
+     * @return the number of segments
+     */
+    size_t segments_count() const { return levels[0].segments.size(); }
+
+    /**
+     * Returns the number of levels of the index.
+     * @return the number of levels of the index
+     */
+    size_t height() const { return levels.size(); }
+
+    /**
+     * Returns the size of the index in bytes, excluding the keys.
+     * @return the size of the index in bytes
+     */
+    size_t size_in_bytes() const {
+        size_t bytes = 0;
+        for (auto &level : levels)
+            bytes += level.segments.size() * sizeof(Segment);
+        return bytes;
+    }
+};
+
+/**
+ * A variant of @ref PGMIndex whose last level is made of quadratic segments, which follow the curvature of skewed
+ * distributions, such as lognormal or geometric ones, with fewer segments than linear ones at the same @p Epsilon.
+ *
+ * Each segment is fitted by least squares on an increasing range of keys, whose length is found with an exponential
+ * and then a binary search. The fit is accepted only if its error, as computed by the same arithmetic of the search,
+ * is at most @p Epsilon on every key of the range, and if it is nondecreasing up to the first key of the next segment.
+ * The upper levels are a @ref PGMIndex on the first keys of the segments.
+ *
+ * @tparam K the type of the indexed keys
+ * @tparam Epsilon controls the size of the returned search range
+ * @tparam EpsilonRecursive controls the size of the search range in the internal structure
+ * @tparam Floating the floating-point type to use for the coefficients of the segments
+ * @tparam Intercept the signed integer type to use for intercepts, which must be able to store the number of keys
+ */
+template<typename K, size_t Epsilon = 64, size_t EpsilonRecursive = 4, typename Floating = float,
+         typename Intercept = int32_t>
+class QuadraticPGMIndex {
+protected:
+    static_assert(Epsilon > 0);
+
+#pragma pack(push, 1)
+
+    struct Segment {
+        K key;               ///< The first key that the segment indexes.
+        Floating a;          ///< The coefficient of the quadratic term.
+        Floating b;          ///< The coefficient of the linear term.
+        Intercept intercept; ///< The intercept of the segment.
+
+        Segment() = default;
+
+        Segment(const K &key, Floating a, Floating b, int64_t intercept)
+            : key(key), a(a), b(b), intercept(Intercept(intercept)) {};
+
+        /** Returns the prediction of the segment without the intercept. */
+        int64_t shift(const K &k) const {
+            auto dx = static_cast<Floating>(k - key);
+            return int64_t(dx * (b + dx * a));
+        }
+
+        size_t operator()(const K &k) const {
+            auto pos = shift(k) + intercept;
+            return pos > 0 ? size_t(pos) : 0ull;
+        }
+    };
+
+#pragma pack(pop)
+
+    using TopIndex = PGMIndex<K, std::max<size_t>(EpsilonRecursive, 1), EpsilonRecursive>;
+
+    size_t n;                      ///< The number of elements this index was built on.
+    K first_key;                   ///< The smallest element.
+    K last_key;                    ///< The largest element.
+    std::vector<Segment> segments; ///< The segments of the last level, followed by a sentinel.
+    TopIndex top;                  ///< The index on the keys of the segments, if EpsilonRecursive > 0.
+
+    /**
+     * Fits a segment on the points in(first), ..., in(last - 1), skipping the ones with the same key of the previous.
+     * @param in a function returning the i-th point
+     * @param first, last the range of positions of the points
+     * @param next_key the first key of the next segment, up to which the segment must be nondecreasing
+     * @param[out] segment the fitted segment
+     * @return @c true if the segment has an error of at most Epsilon on all the points, otherwise @c false
+     */
+    template<typename Fin>
+    static bool fit(Fin in, size_t first, size_t last, const K &next_key, Segment &segment) {
+        auto [x0, y0] = in(first);
+        auto width = double(next_key - x0);
+        double s[5] = {}, t[3] = {};
+        auto prev_x = x0;
+        for (auto i = first; i < last; ++i) {
+            auto [x, y] = in(i);
+            if (i > first && x == prev_x)
+                continue;
+            prev_x = x;
+            auto u = width > 0 ? double(x - x0) / width : 0.0;
+            auto v = double(y) - double(y0);
+            auto u2 = u * u;
+            s[0] += 1, s[1] += u, s[2] += u2, s[3] += u2 * u, s[4] += u2 * u2;
+            t[0] += v, t[1] += u * v, t[2] += u2 * v;
+        }
+
+        // Solve the normal equations for v = c + b u + a u^2, or for a line if they are ill-conditioned
+        double a = 0, b = 0;
+        auto det = s[0] * (s[2] * s[4] - s[3] * s[3]) - s[1] * (s[1] * s[4] - s[3] * s[2])
+                   + s[2] * (s[1] * s[3] - s[2] * s[2]);
+        if (s[0] >= 3 && std::abs(det) > 1e-12 * s[0] * s[0] * s[0]) {
+            b = (s[0] * (t[1] * s[4] - s[3] * t[2]) - t[0] * (s[1] * s[4] - s[3] * s[2])
+                 + s[2] * (s[1] * t[2] - t[1] * s[2])) / det;
+            a = (s[0] * (s[2] * t[2] - t[1] * s[3]) - s[1] * (s[1] * t[2] - t[1] * s[2])
+                 + t[0] * (s[1] * s[3] - s[2] * s[2])) / det;
+        }
+        if (a == 0 || b < 0 || b + 2 * a < 0) {
+            auto var = s[0] * s[2] - s[1] * s[1];
+            a = 0;
+            b = var > 0 ? (s[0] * t[1] - s[1] * t[0]) / var : 0;
+        }
+        segment = Segment(x0, Floating(width > 0 ? a / (width * width) : 0), Floating(width > 0 ? b / width : 0), 0);
+
+        // Check the error with the same arithmetic of the search, then centre the intercept in the error range
+        int64_t min_error = std::numeric_limits<int64_t>::max();
+        int64_t max_error = std::numeric_limits<int64_t>::min();
+        auto prev_shift = std::numeric_limits<int64_t>::min();
+        prev_x = x0;
+        for (auto i = first; i < last; ++i) {
+            auto [x, y] = in(i);
+            if (i > first && x == prev_x)
+                continue;
+            prev_x = x;
+            auto shift = segment.shift(x);
+            if (shift < prev_shift)
+                return false;
+            prev_shift = shift;
+            auto error = shift - int64_t(y - y0);
+            min_error = std::min(min_error, error);
+            max_error = std::max(max_error, error);
+        }
+        if (segment.shift(next_key) < prev_shift || max_error - min_error > int64_t(2 * Epsilon))
+            return false;
+        segment.intercept = int64_t(y0) - (min_error + max_error) / 2;
+        return true;
+    }
+
+    template<typename RandomIt>
+    void build(RandomIt first) {
+        // Here there is the same adjustment for duplicate keys of PGMIndex::build
+        auto in = [&](size_t i) {
+            K x = first[i];
+            auto flag = i > 0 && i + 1u < n && x == first[i - 1] && x != first[i + 1] && x + 1 != first[i + 1];
+            return std::pair<K, size_t>(x + flag, i);
+        };
+        auto next_key = [&](size_t i) { return i < n ? in(i).first : last_key; };
+        auto try_fit = [&](size_t start, size_t end, Segment &segment) {
+            return fit(in, start, end, next_key(end), segment);
+        };
+        // Returns the first position >= i that does not split a run of duplicate keys
+        auto align = [&](size_t i) {
+            while (i < n && in(i).first == in(i - 1).first)
+                ++i;
+            return i;
+        };
+
+        Segment segment, candidate;
+        size_t length = 2 * Epsilon;
+        for (size_t start = 0; start < n;) {
+            // A segment on a single key always fits. Starting from the length of the previous segment, the length is
+            // doubled while the fit succeeds, or halved until it does, then refined by a binary search
+            auto good = align(start + 1);
+            auto bad = n + 1;
+            try_fit(start, good, segment);
+
+            auto end = align(std::min(start + length, n));
+            if (end > good && try_fit(start, end, candidate)) {
+                good = end;
+                segment = candidate;
+                while (good < n) {
+                    end = align(std::min(start + 2 * (good - start), n));
+                    if (!try_fit(start, end, candidate)) {
+                        bad = end;
+                        break;
+                    }
+                    good = end;
+                    segment = candidate;
+                }
+            } else if (end > good) {
+                bad = end;
+                for (auto l = (end - start) / 2; (end = align(start + l)) > good; l /= 2) {
+                    if (try_fit(start, end, candidate)) {
+                        good = end;
+                        segment = candidate;
+                        break;
+                    }
+                    bad = end;
+                }
+            }
+
+            // Stop when the length is known within 1/64, as a longer search would save few segments
+            while (bad <= n && bad - good > (good - start) / 64) {
+                auto mid = align(good + std::max<size_t>((bad - good) / 2, 1));
+                if (mid >= bad)
+                    break;
+                if (try_fit(start, mid, candidate)) {
+                    good = mid;
+                    segment = candidate;
+                } else {
+                    bad = mid;
+                }
+            }
+
+            segments.push_back(segment);
+            length = std::max(good - start, 2 * Epsilon);
+            start = good;
+        }
+    }
+
+    /**
+     * Returns the segment responsible for a given key, that is, the rightmost segment having key <= the sought key.
+     * @param key the value of the element to search for
+     * @return an iterator to the segment responsible for the given key
+     */
+    auto segment_for_key(const K &key) const {
+        auto lo = segments.begin();
+        auto hi = std::prev(segments.end());
+        if constexpr (EpsilonRecursive > 0) {
+            auto range = top.search(key);
+            lo += range.lo;
+            hi = std::min(hi, lo + (range.hi - range.lo) + 1);
+        }
+        auto it = std::upper_bound(lo, hi, key, [](const K &k, const Segment &s) { return k < s.key; });
+        return std::prev(it);
+    }
+
+public:
+
+    static constexpr size_t epsilon_value = Epsilon;
+
+    /**
+     * Constructs an empty index.
+     */
+    QuadraticPGMIndex() = default;
+
+    /**
+     * Constructs the index on the given sorted vector.
+     * @param data the vector of keys to be indexed, must be sorted
+     */
+    explicit QuadraticPGMIndex(const std::vector<K> &data) : QuadraticPGMIndex(data.begin(), data.end()) {}
+
+    /**
+     * Constructs the index on the sorted keys in the range [first, last).
+     * @param first, last the range containing the sorted keys to be indexed
+     */
+    template<typename RandomIt>
+    QuadraticPGMIndex(RandomIt first, RandomIt last)
+        : n(std::distance(first, last)),
+          first_key(n ? *first : K(0)),
+          last_key(n ? *std::prev(last) : K(0)),
+          segments(),
+          top() {
+        if (n == 0)
+            return;
+        if (n > size_t(std::numeric_limits<Intercept>::max()))
+            throw std::overflow_error("Change the Intercept type of QuadraticPGMIndex to int64_t");
+        build(first);
+        segments.emplace_back(last_key, 0, 0, n);
+
+        if constexpr (EpsilonRecursive > 0) {
+            std::vector<K> keys(segments.size() - 1);
+            std::transform(segments.begin(), std::prev(segments.end()), keys.begin(), [](auto &s) { return s.key; });
+            top = TopIndex(keys);
+        }
+    }
+
+    /**
+     * Returns the approximate position and the range where @p key can be found.
+     * @param key the value of the element to search for
+     * @return a struct with the approximate position and bounds of the range
+     */
+    ApproxPos search(const K &key) const {
+        if (n == 0 || key > last_key)
+            return {n, n, n};
+        auto k = std::max(first_key, key);
+        auto it = segment_for_key(k);
+        auto pos = std::min<size_t>((*it)(k), std::max<int64_t>(0, std::next(it)->intercept));
+        auto lo = PGM_SUB_EPS(pos, Epsilon);
+        auto hi = PGM_ADD_EPS(pos, Epsilon, n);
+        return {pos, lo, hi};
+    }
+
+    /**
+     * Returns the number of segments in the last level of the index.
+     * @return the number of segments
+     */
+    size_t segments_count() const { return segments.empty() ? 0 : segments.size() - 1; }
+
+    /**
+     * Returns the number of levels of the index.
+     * @return the number of levels of the index
+     */
+    size_t height() const { return 1 + (EpsilonRecursive > 0 && n ? top.height() : 0); }
+
+    /**
+     * Returns the size of the index in bytes.
+     * @return the size of the index in bytes
+     */
+    size_t size_in_bytes() const { return segments.size() * sizeof(Segment) + (n ? top.size_in_bytes() : 0); }
+};
+
+/**
+ * A variant of @ref PGMIndex whose Epsilon is chosen at construction time, e.g. to fit the index in a space budget
+ * without recompiling.
+ *
+ * The space budget is met by @ref with_space_budget, which estimates the number of segments as a function of
+ * Epsilon by segmenting a sample of the keys, builds the index with the smallest Epsilon that the estimate deems to
+ * fit, and then corrects Epsilon with a few more builds if the estimate was off.
+ *
+ * @tparam K the type of the indexed keys
+ * @tparam EpsilonRecursive controls the size of the search range in the internal structure
+ * @tparam Floating the floating-point type to use for slopes
+ * @tparam Intercept the signed integer type to use for intercepts, which must be able to store the number of keys
+ */
+template<typename K, size_t EpsilonRecursive = 4, typename Floating = float, typename Intercept = int32_t>
+class RuntimePGMIndex {
+protected:
+    using Index = PGMIndex<K, 1, EpsilonRecursive, Floating, Intercept>; ///< Provides the build and the segments.
+    using Segment = typename Index::Segment;
+
+    static constexpr size_t sample_blocks = 16;          ///< The number of blocks of keys segmented by the estimate.
+    static constexpr size_t sample_block_size = 1 << 16; ///< The number of keys in each block.
+
+    size_t n;                                                 ///< The number of elements this index was built on.
+    K first_key;                                              ///< The smallest element.
+    std::vector<Segment, AlignedAllocator<Segment>> segments; ///< The segments composing the index.
+    std::vector<size_t> levels_offsets; ///< The starting position of each level in segments[], in reverse order.
+    size_t epsilon;                     ///< The maximum error of the last level.
+
+public:
+
+    /**
+     * Constructs an empty index.
+     */
+    RuntimePGMIndex() : n(), first_key(), segments(), levels_offsets(), epsilon(1) {}
+
+    /**
+     * Constructs the index on the given sorted vector.
+     * @param data the vector of keys to be indexed, must be sorted
+     * @param epsilon controls the size of the returned search range, must be positive
+     * @param policy the kind of memory pages that back the segments of the index
+     */
+    RuntimePGMIndex(const std::vector<K> &data, size_t epsilon, PagePolicy policy = PagePolicy::Regular)
+        : RuntimePGMIndex(data.begin(), data.end(), epsilon, policy) {}
+
+    /**
+     * Constructs the index on the sorted keys in the range [first, last).
+     * @param first, last the range containing the sorted keys to be indexed
+     * @param epsilon controls the size of the returned search range, must be positive
+     * @param policy the kind of memory pages that back the segments of the index
+     */
+    template<typename RandomIt>
+    RuntimePGMIndex(RandomIt first, RandomIt last, size_t epsilon, PagePolicy policy = PagePolicy::Regular)
+        : n(std::distance(first, last)),
+          first_key(n ? *first : K(0)),
+          segments(AlignedAllocator<Segment>(policy)),
+          levels_offsets(),
+          epsilon(epsilon) {
+        if (epsilon == 0)
+            throw std::invalid_argument("epsilon must be positive");
+        Index::build(first, last, epsilon, EpsilonRecursive, segments, levels_offsets);
+    }
+
+    /**
+     * Estimates the smallest Epsilon such that an index on the sorted keys in the range [first, last) takes at most
+     * @p max_bytes bytes, by fitting the function aε^b to the number of segments computed on a sample of the keys.
+     * @param first, last the range containing the sorted keys to be indexed
+     * @param max_bytes the space budget of the index
+     * @return the estimated Epsilon, between 1 and the number of keys
+     */
+    template<typename RandomIt>
+    static size_t estimate_epsilon(RandomIt first, RandomIt last, size_t max_bytes) {
+        auto n = size_t(std::distance(first, last));
+        auto blocks = n > sample_blocks * sample_block_size ? sample_blocks : 1;
+        auto block_size = blocks > 1 ? sample_block_size : n;
+
+        // Blocks spread over the input capture the distribution better than a prefix of the same size
+        std::vector<std::pair<double, double>> points;
+        size_t e = 4;
+        for (; e * e < block_size; e *= 4) {
+            size_t count = 0;
+            for (size_t b = 0; b < blocks; ++b) {
+                auto offset = blocks > 1 ? b * (n - block_size) / (blocks - 1) : 0;
+                auto in = [&](size_t i) { return std::pair<K, size_t>(first[offset + i], i); };
+                count += internal::make_segmentation(block_size, e, in, [](const auto &) {});
+            }
+            if (count < 4 * blocks)
+                break; // Most blocks are covered by a single segment, so larger values carry no information
+            points.emplace_back(e, double(count) * n / (blocks * block_size));
+        }
+        if (points.size() < 2)
+            return std::clamp<size_t>(e, 1, std::max<size_t>(n, 1));
+
+        // Each segment of the last level is indexed by at most 1/EpsilonRecursive segments in the upper levels
+        auto [a, b] = internal::fit_power_law(points);
+        auto upper_levels_factor = 1 + (EpsilonRecursive ? 1. / EpsilonRecursive : 0.);
+        auto max_segments = double(max_bytes) / (sizeof(Segment) * upper_levels_factor);
+        auto estimate = std::ceil(std::pow(max_segments / a, 1 / b));
+        return estimate >= n ? std::max<size_t>(n, 1) : std::max<size_t>(estimate, 1);
+    }
+
+    /**
+     * Constructs an index on the sorted keys in the range [first, last) that takes at most @p max_bytes bytes.
+     *
+     * The index is first built with the value of Epsilon returned by @ref estimate_epsilon. If it fits, Epsilon is
+     * halved as long as the index still fits, which corrects the estimate on data with few distinct keys. Otherwise,
+     * Epsilon is increased by a quarter until the index fits.
+     *
+     * @param first, last the range containing the sorted keys to be indexed
+     * @param max_bytes the space budget of the index
+     * @param policy the kind of memory pages that back the segments of the index
+     * @return the index
+     */
+    template<typename RandomIt>
+    static RuntimePGMIndex with_space_budget(RandomIt first, RandomIt last, size_t max_bytes,
+                                             PagePolicy policy = PagePolicy::Regular) {
+        auto n = size_t(std::distance(first, last));
+        auto e = estimate_epsilon(first, last, max_bytes);
+        RuntimePGMIndex index(first, last, e, policy);
+        if (index.size_in_bytes() <= max_bytes) {
+            for (; e > 1; e /= 2) {
+                RuntimePGMIndex smaller_index(first, last, e / 2, policy);
+                if (smaller_index.size_in_bytes() > max_bytes)
+                    break;
+                index = std::move(smaller_index);
+            }
+            return index;
+        }
+
+        while (index.size_in_bytes() > max_bytes) {
+            if (e >= n)
+                throw std::invalid_argument("The space budget is smaller than the index with the largest epsilon");
+            e = std::min(n, std::max(e + 1, e + e / 4));
+            index = RuntimePGMIndex(first, last, e, policy);
+        }
+        return index;
+    }
+
+    /**
+     * Returns the result of @ref with_space_budget on the given sorted vector.
+     */
+    static RuntimePGMIndex with_space_budget(const std::vector<K> &data, size_t max_bytes,
+                                             PagePolicy policy = PagePolicy::Regular) {
+        return with_space_budget(data.begin(), data.end(), max_bytes, policy);
+    }
+
+    /**
+     * Returns the approximate position and the range where @p key can be found.
+     * @param key the value of the element to search for
+     * @return a struct with the approximate position and bounds of the range
+     */
+    ApproxPos search(const K &key) const {
+        auto k = std::max(first_key, key);
+        auto it = Index::segment_for_key(segments.data(), levels_offsets.data(), height(), k);
+        auto pos = std::min<size_t>((*it)(k), std::next(it)->intercept);
+        auto lo = PGM_SUB_EPS(pos, epsilon);
+        auto hi = PGM_ADD_EPS(pos, epsilon, n);
+        return {pos, lo, hi};
+    }
+
+    /**
+     * Returns an iterator pointing to the first element in the range [first, last) that is not less than (i.e. greater
+     * or equal to) @p key.
+     * @param first, last the range containing the sorted keys on which the index was built
+     * @param key value to compare the elements to
+     * @return iterator to the first element that is not less than @p key, or @p last if no such element is found
+     */
+    template<typename RandomIt>
+    RandomIt lower_bound(RandomIt first, [[maybe_unused]] RandomIt last, const K &key) const {
+        static constexpr size_t linear_search_threshold = 32;
+        auto range = search(key);
+        if (epsilon <= linear_search_threshold)
+            return internal::lower_bound_in_range<linear_search_threshold>(first + range.lo, first + range.hi, key);
+        return internal::lower_bound_in_range<SIZE_MAX>(first + range.lo, first + range.hi, key);
+    }
+
+    /**
+     * Returns an iterator pointing to the first element in the range [first, last) that is greater than @p key.
+     * @param first, last the range containing the sorted keys on which the index was built
+     * @param key value to compare the elements to
+     * @return iterator to the first element that is greater than @p key, or @p last if no such element is found
+     */
+    template<typename RandomIt>
+    RandomIt upper_bound(RandomIt first, RandomIt last, const K &key) const {
+        return internal::exponential_upper_bound(lower_bound(first, last, key), last, key);
+    }
+
+    /**
+     * Checks if there is an element equal to @p key in the range [first, last).
+     * @param first, last the range containing the sorted keys on which the index was built
+     * @param key value of the element to search for
+     * @return @c true if there is such an element, otherwise @c false
+     */
+    template<typename RandomIt>
+    bool contains(RandomIt first, RandomIt last, const K &key) const {
+        auto it = lower_bound(first, last, key);
+        return it != last && *it == key;
+    }
+
+    /**
+     * Returns the result of @c lower_bound(first, last, key) on the begin and end of the random-access range @p data.
+     */
+    template<typename Range>
+    auto lower_bound(const Range &data, const K &key) const {
+        return lower_bound(std::begin(data), std::end(data), key);
+    }
+
+    /**
+     * Returns the result of @c upper_bound(first, last, key) on the begin and end of the random-access range @p data.
+     */
+    template<typename Range>
+    auto upper_bound(const Range &data, const K &key) const {
+        return upper_bound(std::begin(data), std::end(data), key);
+    }
+
+    /**
+     * Returns the result of @c contains(first, last, key) on the begin and end of the random-access range @p data.
+     */
+    template<typename Range>
+    bool contains(const Range &data, const K &key) const { return contains(std::begin(data), std::end(data), key); }
+
+    /**
+     * Returns the value of Epsilon chosen at construction time.
+     * @return the maximum error of the last level of the index
+     */
+    size_t epsilon_value() const { return epsilon; }
+
+    /**
+     * Returns the number of segments in the last level of the index.
+     * @return the number of segments
+     */
+    size_t segments_count() const { return segments.empty() ? 0 : levels_offsets[1] - 1; }
+
+    /**
+     * Returns the number of levels of the index.
+     * @return the number of levels of the index
+     */
+    size_t height() const { return levels_offsets.size() - 1; }
+
+    /**
+     * Returns the size of the index in bytes.
+     * @return the size of the index in bytes
+     */
+    size_t size_in_bytes() const { return segments.size() * sizeof(Segment) + levels_offsets.size() * sizeof(size_t); }
+};
+
+/**
+ * A variant of @ref PGMIndex in which each segment of the last level has its own maximum error, so that the regions of
+ * the keys that are queried often get smaller search ranges, and the other ones fewer segments.
+ *
+ * The maximum error is given for each key, either by a function or from a sample of the queries. A segment has the
+ * maximum error of its first key, and it is closed before a key requiring a smaller one. When the maximum errors come
+ * from a sample of the queries, the keys are divided into regions, and a region with q queries per key, against an
+ * average of Q queries per key, gets the maximum error Epsilon/sqrt(q/Q) rounded up to a power of sqrt(2) and clamped
+ * to a factor of 16 from Epsilon. Since the number of segments of a region grows roughly as the inverse square of its
+ * maximum error, the index has about the size of a @ref PGMIndex with the given Epsilon, and a smaller expected search
+ * range.
+ *
+ * The search range returned for a key is sized by the larger of the maximum errors of the segment responsible for the
+ * key and of the next one, as a key between the two may be approximated by the intercept of the latter.
+ *
+ * @tparam K the type of the indexed keys
+ * @tparam EpsilonRecursive controls the size of the search range in the internal structure
+ * @tparam Floating the floating-point type to use for slopes
+ * @tparam Intercept the signed integer type to use for intercepts, which must be able to store the number of keys
+ */
+template<typename K, size_t EpsilonRecursive = 4, typename Floating = float, typename Intercept = int32_t>
+class VariableEpsilonPGMIndex {
+protected:
+    using TopIndex = PGMIndex<K, std::max<size_t>(EpsilonRecursive, 1), EpsilonRecursive>;
+
+    static constexpr size_t max_epsilon = std::numeric_limits<uint16_t>::max();
+    static constexpr size_t regions_count = 1024; ///< The number of regions weighted by a sample of the queries.
+    static constexpr size_t max_epsilon_ratio = 16;
+
+#pragma pack(push, 1)
+
+    struct Segment {
+        K key;               ///< The first key that the segment indexes.
+        Floating slope;      ///< The slope of the segment.
+        Intercept intercept; ///< The intercept of the segment.
+        uint16_t epsilon;    ///< The maximum error of the segment.
+
+        Segment() = default;
+
+        Segment(const K &key, Floating slope, Intercept intercept, uint16_t epsilon)
+            : key(key), slope(slope), intercept(intercept), epsilon(epsilon) {};
+
+        Segment(const typename internal::OptimalPiecewiseLinearModel<K, size_t>::CanonicalSegment &cs, size_t epsilon)
+            : key(cs.get_first_x()), epsilon(uint16_t(epsilon)) {
+            auto [cs_slope, cs_intercept] = cs.get_floating_point_segment(key);
+            if (cs_intercept > std::numeric_limits<Intercept>::max())
+                throw std::overflow_error("Change the Intercept type of VariableEpsilonPGMIndex to int64_t");
+            slope = cs_slope;
+            intercept = cs_intercept;
+        }
+
+        size_t operator()(const K &k) const {
+            auto pos = int64_t(slope * (k - key)) + intercept;
+            return pos > 0 ? size_t(pos) : 0ull;
+        }
+    };
+
+#pragma pack(pop)
+
+    size_t n;                      ///< The number of elements this index was built on.
+    K first_key;                   ///< The smallest element.
+    K last_key;                    ///< The largest element.
+    std::vector<Segment> segments; ///< The segments of the last level, followed by a sentinel.
+    TopIndex top;                  ///< The index on the keys of the segments, if EpsilonRecursive > 0.
+
+    /**
+     * Builds the index with the maximum error epsilon_at(i) for the i-th key.
+     */
+    template<typename RandomIt, typename EpsilonAt>
+    void build(RandomIt first, EpsilonAt epsilon_at) {
+        if (n == 0)
+            return;
+        if (n > size_t(std::numeric_limits<Intercept>::max()))
+            throw std::overflow_error("Change the Intercept type of VariableEpsilonPGMIndex to int64_t");
+
+        // Here there is the same adjustment for duplicate keys of PGMIndex::build
+        auto in = [&](size_t i) {
+            K x = first[i];
+            auto flag = i > 0 && i + 1u < n && x == first[i - 1] && x != first[i + 1] && x + 1 != first[i + 1];
+            return std::pair<K, size_t>(x + flag, i);
+        };
+        auto out = [&](const auto &cs, size_t epsilon) { segments.emplace_back(cs, epsilon); };
+        internal::make_variable_segmentation(n, [&](size_t i) {
+            auto e = size_t(epsilon_at(i));
+            if (e == 0 || e > max_epsilon)
+                throw std::invalid_argument("The maximum error of a segment must be between 1 and 65535");
+            return e;
+        }, in, out);
+        segments.emplace_back(last_key, 0, Intercept(n), 0);
+
+        if constexpr (EpsilonRecursive > 0) {
+            std::vector<K> keys(segments.size() - 1);
+            std::transform(segments.begin(), std::prev(segments.end()), keys.begin(), [](auto &s) { return s.key; });
+            top = TopIndex(keys);
+        }
+    }
+
+    /**
+     * Returns the segment responsible for a given key, that is, the rightmost segment having key <= the sought key.
+     * @param key the value of the element to search for
+     * @return an iterator to the segment responsible for the given key
+     */
+    auto segment_for_key(const K &key) const {
+        auto lo = segments.begin();
+        auto hi = std::prev(segments.end());
+        if constexpr (EpsilonRecursive > 0) {
+            auto range = top.search(key);
+            lo += range.lo;
+            hi = std::min(hi, lo + (range.hi - range.lo) + 1);
+        }
+        auto it = std::upper_bound(lo, hi, key, [](const K &k, const Segment &s) { return k < s.key; });
+        return std::prev(it);
+    }
+
+public:
+
+    /**
+     * Constructs an empty index.
+     */
+    VariableEpsilonPGMIndex() = default;
+
+    /**
+     * Constructs the index on the sorted keys in the range [first, last), with the maximum error of each key given by
+     * a function.
+     * @param first, last the range containing the sorted keys to be indexed
+     * @param epsilon_for_key a function returning the maximum error of a key, which must be between 1 and 65535
+     */
+    template<typename RandomIt, typename EpsilonFun,
+             typename = std::enable_if_t<std::is_invocable_r_v<size_t, EpsilonFun, const K &>>>
+    VariableEpsilonPGMIndex(RandomIt first, RandomIt last, EpsilonFun epsilon_for_key)
+        : n(std::distance(first, last)),
+          first_key(n ? *first : K(0)),
+          last_key(n ? *std::prev(last) : K(0)),
+          segments(),
+          top() {
+        build(first, [&](size_t i) { return epsilon_for_key(first[i]); });
+    }
+
+    /**
+     * Constructs the index on the sorted keys in the range [first, last), with smaller maximum errors in the regions
+     * where the keys in @p queries are more frequent, and about the size of a @ref PGMIndex with the given Epsilon.
+     * @param first, last the range containing the sorted keys to be indexed
+     * @param epsilon the maximum error of the regions queried as often as the average, between 1 and 65535
+     * @param queries a sample of the queries, or an empty vector to give all the regions the maximum error @p epsilon
+     */
+    template<typename RandomIt>
+    VariableEpsilonPGMIndex(RandomIt first, RandomIt last, size_t epsilon, const std::vector<K> &queries)
+        : n(std::distance(first, last)),
+          first_key(n ? *first : K(0)),
+          last_key(n ? *std::prev(last) : K(0)),
           segments(),
-          top_level() {
-        if (n == 0)
-            return;
-        std::vector<size_t> offsets;
-        PGMIndex<K, Epsilon, 0, Floating>::build(first, last, Epsilon, 0, segments, offsets);
-        build_top_level();
+          top() {
+        if (epsilon == 0 || epsilon > max_epsilon)
+            throw std::invalid_argument("epsilon must be between 1 and 65535");
+
+        auto regions = std::min(regions_count, std::max<size_t>(n, 1));
+        auto region_size = CEIL_INT_DIV(std::max<size_t>(n, 1), regions);
+        std::vector<size_t> region_queries(regions);
+        for (auto &q : queries) {
+            auto rank = size_t(std::distance(first, std::lower_bound(first, last, q)));
+            ++region_queries[std::min(rank / region_size, regions - 1)];
+        }
+
+        std::vector<uint16_t> region_epsilon(regions);
+        auto min_e = std::max<size_t>(epsilon / max_epsilon_ratio, 1);
+        auto max_e = std::min(epsilon * max_epsilon_ratio, max_epsilon);
+        for (size_t r = 0; r < regions; ++r) {
+            // Rounding up to a power of sqrt(2) keeps the sampling noise from cutting segments between similar regions
+            if (queries.empty()) {
+                region_epsilon[r] = uint16_t(epsilon);
+                continue;
+            }
+            auto density = region_queries[r] * double(regions) / queries.size();
+            auto e = density > 0 ? std::exp2(std::ceil(2 * std::log2(epsilon / std::sqrt(density))) / 2) : max_e;
+            e = std::floor(e);
+            region_epsilon[r] = uint16_t(std::clamp<double>(e, min_e, max_e));
+        }
+        build(first, [&](size_t i) { return region_epsilon[std::min(i / region_size, regions - 1)]; });
     }
 
     /**
@@ -465,117 +2042,407 @@ public:
      * @return a struct with the approximate position and bounds of the range
      */
     ApproxPos search(const K &key) const {
-        if (__builtin_expect(key < first_key, 0))
-            return {0, 0, 0};
-        if (__builtin_expect(key > last_key, 0))
+        if (n == 0 || key > last_key)
             return {n, n, n};
-        auto it = segment_for_key(key);
-        auto pos = std::min<size_t>((*it)(key), std::next(it)->intercept);
-        auto lo = PGM_SUB_EPS(pos, Epsilon);
-        auto hi = PGM_ADD_EPS(pos, Epsilon, n);
+        auto k = std::max(first_key, key);
+        auto it = segment_for_key(k);
+        auto next = std::next(it);
+        auto pos = std::min<size_t>((*it)(k), next->intercept);
+        auto epsilon = std::max(it->epsilon, next->epsilon);
+        auto lo = PGM_SUB_EPS(pos, epsilon);
+        auto hi = PGM_ADD_EPS(pos, epsilon, n);
         return {pos, lo, hi};
     }
 
+    /**
+     * Returns an iterator pointing to the first element in the range [first, last) that is not less than (i.e. greater
+     * or equal to) @p key.
+     * @param first, last the range containing the sorted keys on which the index was built
+     * @param key value to compare the elements to
+     * @return iterator to the first element that is not less than @p key, or @p last if no such element is found
+     */
+    template<typename RandomIt>
+    RandomIt lower_bound(RandomIt first, [[maybe_unused]] RandomIt last, const K &key) const {
+        auto range = search(key);
+        return internal::lower_bound_in_range<SIZE_MAX>(first + range.lo, first + range.hi, key);
+    }
+
+    /**
+     * Returns the result of @c lower_bound(first, last, key) on the begin and end of the random-access range @p data.
+     */
+    template<typename Range>
+    auto lower_bound(const Range &data, const K &key) const {
+        return lower_bound(std::begin(data), std::end(data), key);
+    }
+
     /**
      * Returns the number of segments in the last level of the index.
      * @return the number of segments
      */
-    size_t segments_count() const {
-        return segments.size();
-    }
+    size_t segments_count() const { return segments.empty() ? 0 : segments.size() - 1; }
 
     /**
      * Returns the number of levels of the index.
      * @return the number of levels of the index
      */
-    size_t height() const {
-        return 1;
-    }
+    size_t height() const { return 1 + (EpsilonRecursive > 0 && n ? top.height() : 0); }
 
     /**
      * Returns the size of the index in bytes.
      * @return the size of the index in bytes
      */
-    size_t size_in_bytes() const {
-        return segments.size() * sizeof(Segment) + top_level.size() * top_level.width() / CHAR_BIT;
-    }
+    size_t size_in_bytes() const { return segments.size() * sizeof(Segment) + (n ? top.size_in_bytes() : 0); }
 };
 
 /**
- * A variant of @ref OneLevelPGMIndex that builds a top-level succinct structure to speed up the search on the
- * segments.
+ * A @ref PGMIndex on keys that are not integers, such as floating-point numbers or strings, which are mapped to
+ * integers by a @ref KeyTraits class.
+ *
+ * If the mapping is injective, as for floating-point numbers, the index has the same guarantees of @ref PGMIndex.
+ * Otherwise, as for string prefixes, @ref search returns the range containing the first key whose mapping is not less
+ * than the one of the sought key, and the other query functions refine the result by comparing the keys themselves.
  *
  * @tparam K the type of the indexed keys
  * @tparam Epsilon controls the size of the returned search range
+ * @tparam EpsilonRecursive controls the size of the search range in the internal structure
  * @tparam Floating the floating-point type to use for slopes
+ * @tparam Traits the class that maps the keys to integers
  */
-template<typename K, size_t Epsilon = 64, typename Floating = float>
-class EliasFanoPGMIndex {
+template<typename K, size_t Epsilon = 64, size_t EpsilonRecursive = 4, typename Floating = float,
+         typename Traits = KeyTraits<K>>
+class EncodedPGMIndex {
 protected:
-    static_assert(Epsilon > 0);
+    using Encoded = typename Traits::encoded_type;
 
-    using Segment = typename PGMIndex<K, Epsilon, 0, Floating>::Segment;
+    PGMIndex<Encoded, Epsilon, EpsilonRecursive, Floating> index; ///< The index on the mapped keys.
 
-    struct SegmentData {
-        Floating slope;    ///< The slope of the segment.
-        int32_t intercept; ///< The intercept of the segment.
+public:
 
-        SegmentData() = default;
+    static constexpr size_t epsilon_value = Epsilon;
 
-        SegmentData(Segment &s) : slope(s.slope), intercept(s.intercept) {}
+    /**
+     * Constructs an empty index.
+     */
+    EncodedPGMIndex() = default;
 
-        inline size_t operator()(const K &origin, const K &k) const {
-            auto pos = int64_t(slope * (k - origin)) + intercept;
-            return pos > 0 ? size_t(pos) : 0ull;
+    /**
+     * Constructs the index on the given sorted vector.
+     * @param data the vector of keys to be indexed, must be sorted
+     */
+    explicit EncodedPGMIndex(const std::vector<K> &data) : EncodedPGMIndex(data.begin(), data.end()) {}
+
+    /**
+     * Constructs the index on the sorted keys in the range [first, last).
+     * @param first, last the range containing the sorted keys to be indexed
+     */
+    template<typename RandomIt>
+    EncodedPGMIndex(RandomIt first, RandomIt last)
+        : index(internal::EncodingIterator<RandomIt, Traits>(first),
+                internal::EncodingIterator<RandomIt, Traits>(last)) {}
+
+    /**
+     * Returns the approximate position and the range where the first key whose mapping is not less than the mapping
+     * of @p key can be found.
+     * @param key the value of the element to search for
+     * @return a struct with the approximate position and bounds of the range
+     */
+    ApproxPos search(const K &key) const { return index.search(Traits::encode(key)); }
+
+    /**
+     * Returns an iterator pointing to the first element in the range [first, last) that is not less than @p key.
+     * @param first, last the range containing the sorted keys on which the index was built
+     * @param key value to compare the elements to
+     * @return iterator to the first element that is not less than @p key, or @p last if no such element is found
+     */
+    template<typename RandomIt>
+    RandomIt lower_bound(RandomIt first, RandomIt last, const K &key) const {
+        auto encoded_key = Traits::encode(key);
+        auto range = index.search(encoded_key);
+        auto less = [](const auto &x, const Encoded &k) { return Traits::encode(x) < k; };
+        auto it = std::lower_bound(first + range.lo, first + range.hi, encoded_key, less);
+        if constexpr (Traits::is_exact)
+            return it;
+        else
+            return internal::exponential_lower_bound(it, last, key);
+    }
+
+    /**
+     * Returns an iterator pointing to the first element in the range [first, last) that is greater than @p key.
+     * @param first, last the range containing the sorted keys on which the index was built
+     * @param key value to compare the elements to
+     * @return iterator to the first element that is greater than @p key, or @p last if no such element is found
+     */
+    template<typename RandomIt>
+    RandomIt upper_bound(RandomIt first, RandomIt last, const K &key) const {
+        return internal::exponential_upper_bound(lower_bound(first, last, key), last, key);
+    }
+
+    /**
+     * Returns an iterator pointing to the first element in the range [first, last) that is equal to @p key.
+     * @param first, last the range containing the sorted keys on which the index was built
+     * @param key value of the element to search for
+     * @return iterator to an element equal to @p key, or @p last if no such element is found
+     */
+    template<typename RandomIt>
+    RandomIt find(RandomIt first, RandomIt last, const K &key) const {
+        auto it = lower_bound(first, last, key);
+        return it != last && *it == key ? it : last;
+    }
+
+    /**
+     * Checks if there is an element equal to @p key in the range [first, last).
+     * @param first, last the range containing the sorted keys on which the index was built
+     * @param key value of the element to search for
+     * @return @c true if there is such an element, otherwise @c false
+     */
+    template<typename RandomIt>
+    bool contains(RandomIt first, RandomIt last, const K &key) const { return find(first, last, key) != last; }
+
+    /**
+     * Returns the result of @c lower_bound(first, last, key) on the begin and end of the random-access range @p data.
+     */
+    template<typename Range>
+    auto lower_bound(const Range &data, const K &key) const {
+        return lower_bound(std::begin(data), std::end(data), key);
+    }
+
+    /**
+     * Returns the result of @c upper_bound(first, last, key) on the begin and end of the random-access range @p data.
+     */
+    template<typename Range>
+    auto upper_bound(const Range &data, const K &key) const {
+        return upper_bound(std::begin(data), std::end(data), key);
+    }
+
+    /**
+     * Returns the result of @c find(first, last, key) on the begin and end of the random-access range @p data.
+     */
+    template<typename Range>
+    auto find(const Range &data, const K &key) const { return find(std::begin(data), std::end(data), key); }
+
+    /**
+     * Returns the result of @c contains(first, last, key) on the begin and end of the random-access range @p data.
+     */
+    template<typename Range>
+    bool contains(const Range &data, const K &key) const { return contains(std::begin(data), std::end(data), key); }
+
+    /**
+     * Returns the number of segments in the last level of the index.
+     * @return the number of segments
+     */
+    size_t segments_count() const { return index.segments_count(); }
+
+    /**
+     * Returns the number of levels of the index.
+     * @return the number of levels of the index
+     */
+    size_t height() const { return index.height(); }
+
+    /**
+     * Returns the size of the index in bytes.
+     * @return the size of the index in bytes
+     */
+    size_t size_in_bytes() const { return index.size_in_bytes(); }
+};
+
+/**
+ * A read-only @ref PGMIndex that is searched in place on a buffer or on a memory-mapped file written by
+ * @ref PGMIndex::save.
+ *
+ * Opening the view only validates the header and the level offsets of the buffer, so it takes time proportional to
+ * the height of the index, and the pages of a mapped file are read by the operating system as the searches touch
+ * them. The segments are not validated, but the searches are kept within the levels, so a corrupted segment yields a
+ * wrong search range rather than a read outside the buffer. The template arguments must be equal to the ones of the
+ * saved index, otherwise the constructors throw.
+ *
+ * @tparam K the type of the indexed keys
+ * @tparam Epsilon controls the size of the returned search range
+ * @tparam EpsilonRecursive controls the size of the search range in the internal structure
+ * @tparam Floating the floating-point type to use for slopes
+ * @tparam Intercept the signed integer type to use for intercepts
+ */
+template<typename K, size_t Epsilon = 64, size_t EpsilonRecursive = 4, typename Floating = float,
+         typename Intercept = int32_t>
+class PGMIndexView {
+protected:
+    using Index = PGMIndex<K, Epsilon, EpsilonRecursive, Floating, Intercept>;
+    using Segment = typename Index::Segment;
+
+    size_t n;                     ///< The number of elements the index was built on.
+    K first_key;                  ///< The smallest element.
+    const Segment *segments;      ///< The segments composing the index.
+    const size_t *levels_offsets; ///< The starting position of each level in segments[], in reverse order.
+    size_t levels_offsets_count;  ///< The number of entries of levels_offsets[].
+    size_t segments_size;         ///< The number of entries of segments[].
+    void *mapping;                ///< The address of the mapped file, or @c nullptr if the buffer is not owned.
+    size_t mapping_bytes;         ///< The size of the mapped file.
+
+    void parse(const void *buffer, size_t bytes) {
+        using internal::SerializedHeader;
+        auto base = static_cast<const char *>(buffer);
+        auto expected = SerializedHeader::make<K, Floating, Intercept, Segment>(Epsilon, EpsilonRecursive);
+        if (bytes < sizeof(SerializedHeader))
+            throw std::invalid_argument("The buffer is too small to contain an index");
+        if (reinterpret_cast<uintptr_t>(base) % alignof(size_t) != 0)
+            throw std::invalid_argument("The buffer must be aligned to " + std::to_string(alignof(size_t)) + " bytes");
+
+        SerializedHeader h;
+        std::memcpy(&h, base, sizeof(h));
+        if (std::memcmp(h.magic, expected.magic, sizeof(h.magic)) != 0)
+            throw std::invalid_argument("The buffer does not contain an index");
+        if (h.version != expected.version)
+            throw std::invalid_argument("Unsupported index format version " + std::to_string(h.version));
+        if (h.byte_order != expected.byte_order || h.offset_size != expected.offset_size)
+            throw std::invalid_argument("The index was saved on a machine with a different architecture");
+        if (h.key_size != expected.key_size || h.key_flags != expected.key_flags
+            || h.floating_size != expected.floating_size || h.intercept_size != expected.intercept_size
+            || h.segment_size != expected.segment_size || h.epsilon != expected.epsilon
+            || h.epsilon_recursive != expected.epsilon_recursive)
+            throw std::invalid_argument("The index was saved with different template arguments");
+
+        // Compare the counts with the room left in the buffer before multiplying them, which could overflow
+        auto fits = [&](uint64_t position, uint64_t count, size_t size) {
+            return position <= bytes && count <= (bytes - position) / size;
+        };
+        if (h.levels_offsets_position % alignof(size_t) != 0 || h.levels_offsets_position < sizeof(h)
+            || h.segments_position % alignof(Segment) != 0
+            || !fits(h.levels_offsets_position, h.levels_offsets_count, sizeof(size_t))
+            || !fits(h.segments_position, h.segments_count, sizeof(Segment))
+            || h.segments_position < h.levels_offsets_position + h.levels_offsets_count * sizeof(size_t))
+            throw std::invalid_argument("The index is truncated or corrupted");
+
+        // Each level has at least one segment and a sentinel, and the levels tile segments[]
+        auto offsets = reinterpret_cast<const size_t *>(base + h.levels_offsets_position);
+        auto valid_offsets = h.levels_offsets_count == 0 ? h.segments_count == 0
+                                                         : h.levels_offsets_count >= 2 && offsets[0] == 0
+                                                           && offsets[h.levels_offsets_count - 1] == h.segments_count;
+        for (size_t i = 1; valid_offsets && i < h.levels_offsets_count; ++i)
+            valid_offsets = offsets[i] > offsets[i - 1] + 1;
+        if (!valid_offsets)
+            throw std::invalid_argument("The index is truncated or corrupted");
+
+        n = h.n;
+        std::memcpy(&first_key, h.first_key, sizeof(K));
+        levels_offsets = offsets;
+        levels_offsets_count = h.levels_offsets_count;
+        segments = reinterpret_cast<const Segment *>(base + h.segments_position);
+        segments_size = h.segments_count;
+    }
+
+    /**
+     * Returns the segment responsible for @p key as @ref PGMIndex::segment_for_key does, but keeps the walk within the
+     * levels, so that the intercepts and keys in the buffer, which are not validated, cannot lead it out of segments[].
+     * @param key the value of the element to search for
+     * @return a pointer to the segment responsible for the given key
+     */
+    const Segment *segment_for_key(const K &key) const {
+        if constexpr (EpsilonRecursive == 0) {
+            auto it = std::upper_bound(segments, segments + levels_offsets[1] - 1, key);
+            return it == segments ? it : std::prev(it);
         }
-    };
 
-    size_t n;                           ///< The number of elements this index was built on.
-    K first_key;                        ///< The smallest segment key.
-    std::vector<SegmentData> segments;  ///< The segments composing the index.
-    sdsl::sd_vector<> ef;               ///< The Elias-Fano structure on the segment.
+        auto it = segments + levels_offsets[height() - 1];
+        for (auto l = int(height()) - 2; l >= 0; --l) {
+            auto level_begin = segments + levels_offsets[l];
+            auto level_size = levels_offsets[l + 1] - levels_offsets[l] - 1;
+            auto pos = std::min<size_t>(std::min<size_t>((*it)(key), std::next(it)->intercept), level_size - 1);
+            auto lo = level_begin + PGM_SUB_EPS(pos, EpsilonRecursive + 1);
+
+            static constexpr size_t linear_search_threshold = 8 * 64 / sizeof(Segment);
+            if constexpr (EpsilonRecursive <= linear_search_threshold) {
+                auto level_last = level_begin + level_size - 1;
+                for (; lo < level_last && std::next(lo)->key <= key; ++lo)
+                    continue;
+                it = lo;
+            } else {
+                auto hi = level_begin + PGM_ADD_EPS(pos, EpsilonRecursive, level_size);
+                it = std::upper_bound(lo, std::max(lo, hi), key);
+                it = it == lo ? lo : std::prev(it);
+            }
+        }
+        return it;
+    }
+
+    void unmap() {
+        if (mapping && munmap(mapping, mapping_bytes))
+            std::cerr << "munmap error " << std::string(strerror(errno));
+        mapping = nullptr;
+    }
 
 public:
 
     static constexpr size_t epsilon_value = Epsilon;
 
     /**
-     * Constructs an empty index.
+     * Constructs an empty view.
      */
-    EliasFanoPGMIndex() = default;
+    PGMIndexView()
+        : n(), first_key(), segments(), levels_offsets(), levels_offsets_count(), segments_size(), mapping(),
+          mapping_bytes() {}
 
     /**
-     * Constructs the index on the given sorted vector.
-     * @param data the vector of keys, must be sorted
+     * Constructs a view of the index saved in the given buffer, which must outlive the view.
+     * @param buffer the address of the saved index, aligned to at least @c alignof(size_t) bytes
+     * @param bytes the size of the buffer
      */
-    explicit EliasFanoPGMIndex(const std::vector<K> &data) : EliasFanoPGMIndex(data.begin(), data.end()) {}
+    PGMIndexView(const void *buffer, size_t bytes) : PGMIndexView() { parse(buffer, bytes); }
 
     /**
-     * Constructs the index on the sorted keys in the range [first, last).
-     * @param first, last the range containing the sorted keys to be indexed
+     * Constructs a view of the index saved in the given file, by mapping it in memory.
+     * @param filename the name of the file
      */
-    template<typename RandomIt>
-    EliasFanoPGMIndex(RandomIt first, RandomIt last)
-        : n(std::distance(first, last)),
-          first_key(n ? *first : K(0)),
-          segments(),
-          ef() {
-        if (n == 0)
-            return;
+    explicit PGMIndexView(const std::string &filename) : PGMIndexView() {
+        auto fd = open(filename.c_str(), O_RDONLY);
+        if (fd == -1)
+            throw std::runtime_error("Open file error " + std::string(strerror(errno)));
 
-        std::vector<Segment> tmp;
-        std::vector<size_t> offsets;
-        PGMIndex<K, Epsilon, 0, Floating>::build(first, last, Epsilon, 0, tmp, offsets);
+        struct stat fs;
+        if (fstat(fd, &fs) == -1 || fs.st_size == 0) {
+            close(fd);
+            throw std::runtime_error("The file " + filename + " is empty or cannot be read");
+        }
 
-        segments.reserve(tmp.size());
-        for (auto &x: tmp) {
-            segments.push_back(x);
-            x.key -= first_key;
+        mapping_bytes = fs.st_size;
+        mapping = mmap(nullptr, mapping_bytes, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            mapping = nullptr;
+            throw std::runtime_error("mmap error " + std::string(strerror(errno)));
         }
 
-        ef = decltype(ef)(tmp.begin(), std::prev(tmp.end()));
+        try {
+            parse(mapping, mapping_bytes);
+        } catch (...) {
+            unmap();
+            throw;
+        }
+    }
+
+    PGMIndexView(const PGMIndexView &) = delete;
+    PGMIndexView &operator=(const PGMIndexView &) = delete;
+
+    PGMIndexView(PGMIndexView &&other) noexcept : PGMIndexView() { *this = std::move(other); }
+
+    PGMIndexView &operator=(PGMIndexView &&other) noexcept {
+        if (this != &other) {
+            unmap();
+            n = other.n;
+            first_key = other.first_key;
+            segments = other.segments;
+            levels_offsets = other.levels_offsets;
+            levels_offsets_count = other.levels_offsets_count;
+            segments_size = other.segments_size;
+            mapping = std::exchange(other.mapping, nullptr);
+            mapping_bytes = other.mapping_bytes;
+        }
+        return *this;
     }
 
+    /**
+     * Destructs the view and unmaps the file backing it, if any.
+     */
+    ~PGMIndexView() { unmap(); }
+
     /**
      * Returns the approximate position and the range where @p key can be found.
      * @param key the value of the element to search for
@@ -583,62 +2450,65 @@ public:
      */
     ApproxPos search(const K &key) const {
         auto k = std::max(first_key, key);
-        auto[r, origin] = pred(k - first_key);
-        auto pos = std::min<size_t>(segments[r](origin + first_key, k), segments[r + 1].intercept);
+        auto it = segment_for_key(k);
+        auto pos = std::min<size_t>(std::min<size_t>((*it)(k), std::next(it)->intercept), n);
         auto lo = PGM_SUB_EPS(pos, Epsilon);
         auto hi = PGM_ADD_EPS(pos, Epsilon, n);
         return {pos, lo, hi};
     }
 
     /**
-     * Returns the number of segments in the last level of the index.
-     * @return the number of segments
+     * Returns an iterator pointing to the first element in the range [first, last) that is not less than @p key.
+     * @param first, last the range containing the sorted keys on which the index was built
+     * @param key value to compare the elements to
+     * @return iterator to the first element that is not less than @p key, or @p last if no such element is found
      */
-    size_t segments_count() const {
-        return segments.size();
+    template<typename RandomIt>
+    RandomIt lower_bound(RandomIt first, [[maybe_unused]] RandomIt last, const K &key) const {
+        auto range = search(key);
+        return internal::lower_bound_in_range<Epsilon>(first + range.lo, first + range.hi, key);
     }
 
     /**
-     * Returns the number of levels of the index.
-     * @return the number of levels of the index
+     * Returns an iterator pointing to the first element in the range [first, last) that is greater than @p key.
+     * @param first, last the range containing the sorted keys on which the index was built
+     * @param key value to compare the elements to
+     * @return iterator to the first element that is greater than @p key, or @p last if no such element is found
      */
-    size_t height() const {
-        return 1;
+    template<typename RandomIt>
+    RandomIt upper_bound(RandomIt first, RandomIt last, const K &key) const {
+        return internal::exponential_upper_bound(lower_bound(first, last, key), last, key);
     }
 
     /**
-     * Returns the size of the index in bytes.
-     * @return the size of the index in bytes
+     * Checks if there is an element equal to @p key in the range [first, last).
+     * @param first, last the range containing the sorted keys on which the index was built
+     * @param key value of the element to search for
+     * @return @c true if there is such an element, otherwise @c false
      */
-    size_t size_in_bytes() const {
-        return segments.size() * sizeof(SegmentData) + sdsl::size_in_bytes(ef);
+    template<typename RandomIt>
+    bool contains(RandomIt first, RandomIt last, const K &key) const {
+        auto it = lower_bound(first, last, key);
+        return it != last && *it == key;
     }
 
-private:
-
-    std::pair<size_t, uint64_t> pred(uint64_t i) const {
-        if (i > ef.size()) {
-            auto j = ef.low.size();
-            return {j - 1, ef.low[j - 1] + ((ef.high_1_select(j) + 1 - j) << (ef.wl))};
-        }
-        ++i;
+    /**
+     * Returns the number of segments in the last level of the index.
+     * @return the number of segments
+     */
+    size_t segments_count() const { return segments_size == 0 ? 0 : levels_offsets[1] - 1; }
 
-        auto high_val = (i >> (ef.wl));
-        auto sel_high = ef.high_0_select(high_val + 1);
-        auto rank_low = sel_high - high_val;
-        if (0 == rank_low)
-            return {0, ef.low[0] + (high_val << ef.wl)};
+    /**
+     * Returns the number of levels of the index.
+     * @return the number of levels of the index
+     */
+    size_t height() const { return levels_offsets_count - 1; }
 
-        auto val_low = i & sdsl::bits::lo_set[ef.wl];
-        do {
-            if (!sel_high)
-                return {0, ef.low[rank_low] + (high_val < ef.wl)};
-            --sel_high;
-            --rank_low;
-        } while (ef.high[sel_high] and ef.low[rank_low] >= val_low);
-        auto h = ef.high[sel_high] ? high_val : sdsl::bits::prev(ef.high.data(), sel_high) - rank_low;
-        return {rank_low, ef.low[rank_low] + (h << ef.wl)};
-    }
+    /**
+     * Returns the size of the index in bytes.
+     * @return the size of the index in bytes
+     */
+    size_t size_in_bytes() const { return segments_size * sizeof(Segment) + levels_offsets_count * sizeof(size_t); }
 };
 
 /**
@@ -729,34 +2599,21 @@ public:
      * @param key the value of the element to search for
      * @return @c true if there is such an element, otherwise @c false
      */
-    bool contains(const K &key) const {
-        auto range = this->search(key);
-        return std::binary_search(begin() + range.lo, begin() + range.hi, key);
-    }
+    bool contains(const K &key) const { return base::contains(begin(), end(), key); }
 
     /**
      * Returns an iterator pointing to the first element that is not less than (i.e. greater or equal to) @p key.
      * @param key value to compare the elements to
      * @return iterator to the first element that is not less than @p key, or @ref end() if no such element is found
      */
-    auto lower_bound(const K &key) const {
-        auto range = this->search(key);
-        return std::lower_bound(begin() + range.lo, begin() + range.hi, key);
-    }
+    auto lower_bound(const K &key) const { return base::lower_bound(begin(), end(), key); }
 
     /**
      * Returns an iterator pointing to the first element that is greater than @p key.
      * @param key value to compare the elements to
      * @return iterator to the first element that is greater than @p key, or @ref end() if no such element is found
      */
-    auto upper_bound(const K &key) const {
-        auto range = this->search(key);
-        auto it = std::upper_bound(begin() + range.lo, begin() + range.hi, key);
-        auto step = 1ull;
-        while (it + step < end() && *(it + step) == key)  // exponential search to skip duplicates
-            step *= 2;
-        return std::upper_bound(it + (step / 2), std::min(it + step, end()), key);
-    }
+    auto upper_bound(const K &key) const { return base::upper_bound(begin(), end(), key); }
 
     /**
      * Returns the number of elements with key equal to the specified argument.
@@ -764,10 +2621,8 @@ public:
      * @return the number of elements with key equal to @p key
      */
     size_t count(const K &key) const {
-        auto lb = lower_bound(key);
-        if (lb == end() || *lb != key)
-            return 0;
-        return std::distance(lb, upper_bound(key));
+        auto[lb, ub] = base::equal_range(begin(), end(), key);
+        return std::distance(lb, ub);
     }
 
     /**
@@ -855,12 +2710,8 @@ private:
         using value_type = typename C::value_type;
         typename C::size_type size;
         read_member(size, in);
-        container.reserve(size);
-        for (size_t i = 0; i < size; ++i) {
-            value_type s;
-            in.read((char *) &s, sizeof(value_type));
-            container.push_back(s);
-        }
+        container.resize(size);
+        in.read((char *) container.data(), size * sizeof(value_type));
     }
 };
 
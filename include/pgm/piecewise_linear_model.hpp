@@ -16,10 +16,13 @@
 #pragma once
 
 #include <algorithm>
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <iterator>
 #include <limits>
+#include <numeric>
+#include <optional>
 #include <stdexcept>
 #include <type_traits>
 #include <utility>
@@ -35,10 +38,115 @@
 
 namespace pgm::internal {
 
+/**
+ * A 256-bit signed integer in two's complement, supporting just the operations needed to compare the slopes between
+ * points having 128-bit coordinates.
+ */
+class Int256 {
+    using u128 = unsigned __int128;
+
+    u128 lo = 0; ///< The 128 least significant bits.
+    u128 hi = 0; ///< The 128 most significant bits.
+
+    Int256(u128 hi, u128 lo) : lo(lo), hi(hi) {}
+
+    /** Returns the 256-bit product of two unsigned 128-bit integers. */
+    static Int256 multiply(u128 a, u128 b) {
+        auto a_lo = uint64_t(a), a_hi = uint64_t(a >> 64);
+        auto b_lo = uint64_t(b), b_hi = uint64_t(b >> 64);
+        auto lo_lo = u128(a_lo) * b_lo;
+        auto hi_lo = u128(a_hi) * b_lo;
+        auto lo_hi = u128(a_lo) * b_hi;
+        auto hi_hi = u128(a_hi) * b_hi;
+        auto middle = (lo_lo >> 64) + uint64_t(hi_lo) + uint64_t(lo_hi);
+        return {hi_hi + (hi_lo >> 64) + (lo_hi >> 64) + (middle >> 64), (middle << 64) | uint64_t(lo_lo)};
+    }
+
+public:
+
+    Int256() = default;
+
+    template<typename T, typename = std::enable_if_t<std::is_integral_v<T>>>
+    Int256(T x) : lo(u128(x)), hi(std::is_signed_v<T> && x < 0 ? ~u128(0) : 0) {}
+
+    explicit operator long double() const {
+        constexpr auto two_pow_128 = 18446744073709551616.0L * 18446744073709551616.0L;
+        return static_cast<long double>(static_cast<__int128>(hi)) * two_pow_128 + static_cast<long double>(lo);
+    }
+
+    friend Int256 operator-(const Int256 &a, const Int256 &b) { return {a.hi - b.hi - (a.lo < b.lo), a.lo - b.lo}; }
+
+    friend Int256 operator*(const Int256 &a, const Int256 &b) {
+        auto p = multiply(a.lo, b.lo);
+        return {p.hi + a.lo * b.hi + a.hi * b.lo, p.lo};
+    }
+
+    friend bool operator<(const Int256 &a, const Int256 &b) {
+        return a.hi != b.hi ? static_cast<__int128>(a.hi) < static_cast<__int128>(b.hi) : a.lo < b.lo;
+    }
+
+    friend bool operator==(const Int256 &a, const Int256 &b) { return a.hi == b.hi && a.lo == b.lo; }
+    friend bool operator!=(const Int256 &a, const Int256 &b) { return !(a == b); }
+    friend bool operator>(const Int256 &a, const Int256 &b) { return b < a; }
+    friend bool operator<=(const Int256 &a, const Int256 &b) { return !(b < a); }
+    friend bool operator>=(const Int256 &a, const Int256 &b) { return !(a < b); }
+};
+
 template<typename T>
 using LargeSigned = typename std::conditional_t<std::is_floating_point_v<T>,
                                                 long double,
-                                                std::conditional_t<(sizeof(T) < 8), int64_t, __int128>>;
+                                                std::conditional_t<(sizeof(T) < 8), int64_t,
+                                                                   std::conditional_t<(sizeof(T) == 8), __int128,
+                                                                                      Int256>>>;
+
+/**
+ * A per-thread pool of the vectors that store the convex hulls of @ref OptimalPiecewiseLinearModel, so that the models
+ * created one after the other on a thread, e.g. by many small index builds, reuse the capacity of the previous ones
+ * instead of allocating and faulting in new memory.
+ */
+template<typename T>
+class HullBufferPool {
+    static constexpr size_t max_pooled_buffers = 8;         ///< The maximum number of free vectors kept per thread.
+    static constexpr size_t max_pooled_capacity = 1u << 16; ///< Vectors with a larger capacity are freed.
+
+    struct FreeBuffers {
+        std::vector<std::vector<T>> buffers;
+        ~FreeBuffers() { destroyed = true; }
+    };
+
+    static inline thread_local bool destroyed = false; ///< Whether the pool of this thread has been destroyed.
+
+    /**
+     * Returns the free vectors of this thread, or nullptr if the pool was destroyed with the thread-local objects, e.g.
+     * when a model with static storage duration is destroyed at exit.
+     */
+    static std::vector<std::vector<T>> *free_buffers() {
+        if (destroyed)
+            return nullptr;
+        thread_local FreeBuffers pool;
+        return &pool.buffers;
+    }
+
+public:
+
+    /** Returns an empty vector, with the capacity of a vector released before on this thread, if any. */
+    static std::vector<T> acquire() {
+        auto buffers = free_buffers();
+        if (!buffers || buffers->empty())
+            return {};
+        auto v = std::move(buffers->back());
+        buffers->pop_back();
+        v.clear();
+        return v;
+    }
+
+    /** Gives back a vector to the pool of this thread, or frees it if the pool was destroyed. */
+    static void release(std::vector<T> &&v) {
+        auto buffers = free_buffers();
+        if (buffers && v.capacity() > 0 && v.capacity() <= max_pooled_capacity && buffers->size() < max_pooled_buffers)
+            buffers->push_back(std::move(v));
+    }
+};
 
 template<typename X, typename Y>
 class OptimalPiecewiseLinearModel {
@@ -57,6 +165,18 @@ private:
         explicit operator long double() const { return dy / (long double) dx; }
     };
 
+    /**
+     * A slope between two points whose coordinates differ by less than 2^62, which is compared with a single
+     * 64x64->128 bit multiplication per side rather than with the wider arithmetic of @ref Slope.
+     */
+    struct NarrowSlope {
+        int64_t dx{};
+        int64_t dy{};
+
+        bool operator<(const NarrowSlope &p) const { return __int128(dy) * p.dx < __int128(dx) * p.dy; }
+        bool operator>(const NarrowSlope &p) const { return __int128(dy) * p.dx > __int128(dx) * p.dy; }
+    };
+
     struct Point {
         X x{};
         Y y{};
@@ -64,6 +184,11 @@ private:
         Slope operator-(const Point &p) const { return {SX(x) - p.x, SY(y) - p.y}; }
     };
 
+    /** Whether the coordinates of the points can be narrowed to 64-bit integers, if close enough to each other. */
+    static constexpr bool narrowable = !std::is_floating_point_v<X> && std::is_integral_v<Y> && sizeof(X) <= 16
+                                       && sizeof(Y) <= 8;
+    static constexpr int64_t narrow_bound = int64_t(1) << 60;
+
     const Y epsilon;
     std::vector<Point> lower;
     std::vector<Point> upper;
@@ -73,73 +198,63 @@ private:
     size_t upper_start = 0;
     size_t points_in_hull = 0;
     Point rectangle[4];
-
-    auto cross(const Point &O, const Point &A, const Point &B) const {
-        auto OA = A - O;
-        auto OB = B - O;
-        return OA.dx * OB.dy - OA.dy * OB.dx;
+    Y first_y = 0;
+    bool narrow = false; ///< Whether all the points in the hull are closer than 2 * narrow_bound on both axes.
+
+    /** Returns the slope of type @p S of the segment from @p b to @p a. */
+    template<typename S>
+    static S slope(const Point &a, const Point &b) {
+        if constexpr (std::is_same_v<S, NarrowSlope>) {
+            // The true differences fit in 64 bits, so they are equal to the wrapping differences of the low 64 bits
+            return {int64_t(uint64_t(a.x) - uint64_t(b.x)), int64_t(uint64_t(a.y) - uint64_t(b.y))};
+        } else {
+            return a - b;
+        }
     }
 
-public:
-
-    class CanonicalSegment;
-
-    explicit OptimalPiecewiseLinearModel(Y epsilon) : epsilon(epsilon), lower(), upper() {
-        if (epsilon < 0)
-            throw std::invalid_argument("epsilon cannot be negative");
-
-        upper.reserve(1u << 16);
-        lower.reserve(1u << 16);
+    template<typename S>
+    auto cross(const Point &O, const Point &A, const Point &B) const {
+        auto OA = slope<S>(A, O);
+        auto OB = slope<S>(B, O);
+        if constexpr (std::is_same_v<S, NarrowSlope>)
+            return __int128(OA.dx) * OB.dy - __int128(OA.dy) * OB.dx;
+        else
+            return OA.dx * OB.dy - OA.dy * OB.dx;
     }
 
-    bool add_point(const X &x, const Y &y) {
-        if (points_in_hull > 0 && x <= last_x)
-            throw std::logic_error("Points must be increasing by x.");
-
-        last_x = x;
-        auto max_y = std::numeric_limits<Y>::max();
-        auto min_y = std::numeric_limits<Y>::lowest();
-        Point p1{x, y >= max_y - epsilon ? max_y : y + epsilon};
-        Point p2{x, y <= min_y + epsilon ? min_y : y - epsilon};
-
-        if (points_in_hull == 0) {
-            first_x = x;
-            rectangle[0] = p1;
-            rectangle[1] = p2;
-            upper.clear();
-            lower.clear();
-            upper.push_back(p1);
-            lower.push_back(p2);
-            upper_start = lower_start = 0;
-            ++points_in_hull;
-            return true;
-        }
-
-        if (points_in_hull == 1) {
-            rectangle[2] = p2;
-            rectangle[3] = p1;
-            upper.push_back(p1);
-            lower.push_back(p2);
-            ++points_in_hull;
-            return true;
+    /** Checks if the point (x, y) is close enough to the first point of the hull to keep using narrow slopes. */
+    bool is_narrow(const X &x, const Y &y) const {
+        if constexpr (narrowable) {
+            auto dx = SX(x) - SX(first_x);
+            auto dy = SY(y) - SY(first_y);
+            return SX(-narrow_bound) < dx && dx < SX(narrow_bound) && SY(-narrow_bound) < dy && dy < SY(narrow_bound);
+        } else {
+            return false;
         }
+    }
 
-        auto slope1 = rectangle[2] - rectangle[0];
-        auto slope2 = rectangle[3] - rectangle[1];
-        bool outside_line1 = p1 - rectangle[2] < slope1;
-        bool outside_line2 = p2 - rectangle[3] > slope2;
+    /**
+     * Adds the points @p p1 and @p p2, which have the same abscissa, to a hull containing at least two points,
+     * comparing the slopes with the arithmetic of @p S.
+     */
+    template<typename S>
+    bool add_point_to_hull(const Point &p1, const Point &p2) {
+        auto slope1 = slope<S>(rectangle[2], rectangle[0]);
+        auto slope2 = slope<S>(rectangle[3], rectangle[1]);
+        bool outside_line1 = slope<S>(p1, rectangle[2]) < slope1;
+        bool outside_line2 = slope<S>(p2, rectangle[3]) > slope2;
 
         if (outside_line1 || outside_line2) {
             points_in_hull = 0;
             return false;
         }
 
-        if (p1 - rectangle[1] < slope2) {
+        if (slope<S>(p1, rectangle[1]) < slope2) {
             // Find extreme slope
-            auto min = lower[lower_start] - p1;
+            auto min = slope<S>(lower[lower_start], p1);
             auto min_i = lower_start;
             for (auto i = lower_start + 1; i < lower.size(); i++) {
-                auto val = lower[i] - p1;
+                auto val = slope<S>(lower[i], p1);
                 if (val > min)
                     break;
                 min = val;
@@ -152,18 +267,18 @@ public:
 
             // Hull update
             auto end = upper.size();
-            for (; end >= upper_start + 2 && cross(upper[end - 2], upper[end - 1], p1) <= 0; --end)
+            for (; end >= upper_start + 2 && cross<S>(upper[end - 2], upper[end - 1], p1) <= 0; --end)
                 continue;
             upper.resize(end);
             upper.push_back(p1);
         }
 
-        if (p2 - rectangle[0] > slope1) {
+        if (slope<S>(p2, rectangle[0]) > slope1) {
             // Find extreme slope
-            auto max = upper[upper_start] - p2;
+            auto max = slope<S>(upper[upper_start], p2);
             auto max_i = upper_start;
             for (auto i = upper_start + 1; i < upper.size(); i++) {
-                auto val = upper[i] - p2;
+                auto val = slope<S>(upper[i], p2);
                 if (val < max)
                     break;
                 max = val;
@@ -176,7 +291,7 @@ public:
 
             // Hull update
             auto end = lower.size();
-            for (; end >= lower_start + 2 && cross(lower[end - 2], lower[end - 1], p2) >= 0; --end)
+            for (; end >= lower_start + 2 && cross<S>(lower[end - 2], lower[end - 1], p2) >= 0; --end)
                 continue;
             lower.resize(end);
             lower.push_back(p2);
@@ -186,6 +301,68 @@ public:
         return true;
     }
 
+public:
+
+    class CanonicalSegment;
+
+    explicit OptimalPiecewiseLinearModel(Y epsilon)
+        : epsilon(epsilon),
+          lower(HullBufferPool<Point>::acquire()),
+          upper(HullBufferPool<Point>::acquire()) {
+        if (epsilon < 0)
+            throw std::invalid_argument("epsilon cannot be negative");
+    }
+
+    OptimalPiecewiseLinearModel(const OptimalPiecewiseLinearModel &) = default;
+
+    OptimalPiecewiseLinearModel(OptimalPiecewiseLinearModel &&) noexcept = default;
+
+    ~OptimalPiecewiseLinearModel() {
+        HullBufferPool<Point>::release(std::move(lower));
+        HullBufferPool<Point>::release(std::move(upper));
+    }
+
+    bool add_point(const X &x, const Y &y) {
+        if (points_in_hull > 0 && x <= last_x)
+            throw std::logic_error("Points must be increasing by x.");
+
+        last_x = x;
+        auto max_y = std::numeric_limits<Y>::max();
+        auto min_y = std::numeric_limits<Y>::lowest();
+        Point p1{x, y >= max_y - epsilon ? max_y : y + epsilon};
+        Point p2{x, y <= min_y + epsilon ? min_y : y - epsilon};
+
+        if (points_in_hull == 0) {
+            first_x = x;
+            first_y = y;
+            narrow = narrowable && SY(epsilon) < SY(narrow_bound);
+            rectangle[0] = p1;
+            rectangle[1] = p2;
+            upper.clear();
+            lower.clear();
+            upper.push_back(p1);
+            lower.push_back(p2);
+            upper_start = lower_start = 0;
+            ++points_in_hull;
+            return true;
+        }
+
+        if (points_in_hull == 1) {
+            rectangle[2] = p2;
+            rectangle[3] = p1;
+            upper.push_back(p1);
+            lower.push_back(p2);
+            ++points_in_hull;
+            return true;
+        }
+
+        // Once a point is far from the first one, the hull stays on the wide arithmetic until the next segment
+        narrow = narrow && is_narrow(x, y);
+        if (narrow)
+            return add_point_to_hull<NarrowSlope>(p1, p2);
+        return add_point_to_hull<Slope>(p1, p2);
+    }
+
     CanonicalSegment get_segment() {
         if (points_in_hull == 1)
             return CanonicalSegment(rectangle[0], rectangle[1], first_x);
@@ -216,13 +393,11 @@ class OptimalPiecewiseLinearModel<X, Y>::CanonicalSegment {
             && rectangle[1].x == rectangle[3].x && rectangle[1].y == rectangle[3].y;
     }
 
-public:
-
-    CanonicalSegment() = default;
-
-    X get_first_x() const { return first; }
-
-    std::pair<long double, long double> get_intersection() const {
+    /**
+     * Returns the fraction b such that the intersection of the diagonals of the rectangle is rectangle[0] plus b times
+     * (rectangle[2] - rectangle[0]), or 0 if the diagonals are parallel.
+     */
+    long double get_intersection_fraction() const {
         auto &p0 = rectangle[0];
         auto &p1 = rectangle[1];
         auto &p2 = rectangle[2];
@@ -231,13 +406,25 @@ public:
         auto slope2 = p3 - p1;
 
         if (one_point() || slope1 == slope2)
-            return {p0.x, p0.y};
+            return 0;
 
         auto p0p1 = p1 - p0;
         auto a = slope1.dx * slope2.dy - slope1.dy * slope2.dx;
-        auto b = (p0p1.dx * slope2.dy - p0p1.dy * slope2.dx) / static_cast<long double>(a);
-        auto i_x = p0.x + b * slope1.dx;
-        auto i_y = p0.y + b * slope1.dy;
+        return static_cast<long double>(p0p1.dx * slope2.dy - p0p1.dy * slope2.dx) / static_cast<long double>(a);
+    }
+
+public:
+
+    CanonicalSegment() = default;
+
+    X get_first_x() const { return first; }
+
+    std::pair<long double, long double> get_intersection() const {
+        auto &p0 = rectangle[0];
+        auto slope1 = rectangle[2] - p0;
+        auto b = get_intersection_fraction();
+        auto i_x = p0.x + b * static_cast<long double>(slope1.dx);
+        auto i_y = p0.y + b * static_cast<long double>(slope1.dy);
         return {i_x, i_y};
     }
 
@@ -245,7 +432,7 @@ public:
         if (one_point())
             return {0, (rectangle[0].y + rectangle[1].y) / 2};
 
-        if constexpr (std::is_integral_v<X> && std::is_integral_v<Y>) {
+        if constexpr (std::is_integral_v<X> && std::is_integral_v<Y> && sizeof(X) <= 8) {
             auto slope = rectangle[3] - rectangle[1];
             auto intercept_n = slope.dy * (SX(origin) - rectangle[1].x);
             auto intercept_d = slope.dx;
@@ -254,9 +441,19 @@ public:
             return {static_cast<long double>(slope), intercept};
         }
 
-        auto[i_x, i_y] = get_intersection();
         auto[min_slope, max_slope] = get_slope_range();
         auto slope = (min_slope + max_slope) / 2.;
+        if constexpr (std::is_integral_v<X> && sizeof(X) > 8) {
+            // A long double cannot hold 128-bit keys exactly, so the distance from origin is computed with integers
+            auto &p0 = rectangle[0];
+            auto slope1 = rectangle[2] - p0;
+            auto b = get_intersection_fraction();
+            auto i_x = static_cast<long double>(SX(p0.x) - origin) + b * static_cast<long double>(slope1.dx);
+            auto i_y = p0.y + b * static_cast<long double>(slope1.dy);
+            return {slope, i_y - i_x * slope};
+        }
+
+        auto[i_x, i_y] = get_intersection();
         auto intercept = i_y - (i_x - origin) * slope;
         return {slope, intercept};
     }
@@ -271,72 +468,180 @@ public:
     }
 };
 
+/**
+ * Computes the optimal segmentation of the points in(first), ..., in(last - 1) that starts a segment at in(first).
+ *
+ * For each segment, calls out(cs, start, next_start), where cs is the canonical segment, start is the index of its
+ * first point, and next_start is the index of the first point of the next segment, or @p last if there is none. The
+ * computation stops early if @p out returns false.
+ *
+ * @return the number of segments passed to @p out
+ */
 template<typename Fin, typename Fout>
-size_t make_segmentation(size_t n, size_t epsilon, Fin in, Fout out) {
-    if (n == 0)
+size_t make_segmentation_from(size_t first, size_t last, size_t epsilon, Fin in, Fout out) {
+    if (first >= last)
         return 0;
 
     using X = typename std::invoke_result_t<Fin, size_t>::first_type;
     using Y = typename std::invoke_result_t<Fin, size_t>::second_type;
     size_t c = 0;
-    auto p = in(0);
+    size_t start = first;
+    auto p = in(first);
 
     OptimalPiecewiseLinearModel<X, Y> opt(epsilon);
     opt.add_point(p.first, p.second);
 
-    for (size_t i = 1; i < n; ++i) {
+    for (size_t i = first + 1; i < last; ++i) {
         auto next_p = in(i);
         if (next_p.first == p.first)
             continue;
         p = next_p;
         if (!opt.add_point(p.first, p.second)) {
-            out(opt.get_segment());
-            opt.add_point(p.first, p.second);
             ++c;
+            if (!out(opt.get_segment(), start, i))
+                return c;
+            opt.add_point(p.first, p.second);
+            start = i;
         }
     }
 
-    out(opt.get_segment());
+    out(opt.get_segment(), start, last);
     return ++c;
 }
 
 template<typename Fin, typename Fout>
-size_t make_segmentation_par(size_t n, size_t epsilon, Fin in, Fout out) {
-    auto parallelism = std::min(std::min(omp_get_num_procs(), omp_get_max_threads()), 20);
-    auto chunk_size = n / parallelism;
-    auto c = 0ull;
+size_t make_segmentation(size_t n, size_t epsilon, Fin in, Fout out) {
+    return make_segmentation_from(0, n, epsilon, in, [&](const auto &cs, size_t, size_t) {
+        out(cs);
+        return true;
+    });
+}
+
+/**
+ * Computes a segmentation of the points in(0), ..., in(n - 1) in which the i-th point must be approximated with an
+ * error of at most epsilon(i). The maximum error of a segment is the one of its first point, and a segment is also
+ * closed before a point that requires a smaller error. For each segment, calls out(cs, e), where cs is the canonical
+ * segment and e is its maximum error.
+ *
+ * @return the number of segments passed to @p out
+ */
+template<typename Fin, typename Feps, typename Fout>
+size_t make_variable_segmentation(size_t n, Feps epsilon, Fin in, Fout out) {
+    if (n == 0)
+        return 0;
+
+    using X = typename std::invoke_result_t<Fin, size_t>::first_type;
+    using Y = typename std::invoke_result_t<Fin, size_t>::second_type;
+    size_t c = 0;
+    size_t e = epsilon(0);
+    auto p = in(0);
+
+    std::optional<OptimalPiecewiseLinearModel<X, Y>> opt(std::in_place, e);
+    opt->add_point(p.first, p.second);
+
+    for (size_t i = 1; i < n; ++i) {
+        auto next_p = in(i);
+        if (next_p.first == p.first)
+            continue;
+        p = next_p;
+        size_t next_e = epsilon(i);
+        if (next_e < e || !opt->add_point(p.first, p.second)) {
+            ++c;
+            out(opt->get_segment(), e);
+            if (next_e != e) {
+                e = next_e;
+                opt.emplace(e);
+            }
+            opt->add_point(p.first, p.second);
+        }
+    }
+
+    out(opt->get_segment(), e);
+    return ++c;
+}
 
-    if (parallelism == 1 || n < 1ull << 15)
+/**
+ * Computes the same segmentation of @ref make_segmentation using @p parallelism threads, or all the available ones if
+ * @p parallelism is zero.
+ *
+ * The points are split into chunks that are segmented in parallel. Since the last segment of a chunk is cut by the end
+ * of the chunk, the segmentation is then resumed sequentially from the start of that segment until it starts a segment
+ * at the same point of a segment computed for the next chunk, from which point on the two segmentations coincide.
+ */
+template<typename Fin, typename Fout>
+size_t make_segmentation_par(size_t n, size_t epsilon, Fin in, Fout out, size_t parallelism = 0) {
+    static constexpr size_t min_chunk_size = 1ull << 14;
+    if (parallelism == 0)
+        parallelism = std::min(omp_get_num_procs(), omp_get_max_threads());
+    parallelism = std::min(parallelism, n / min_chunk_size);
+    auto chunk_size = parallelism ? n / parallelism : n;
+
+    if (parallelism <= 1)
         return make_segmentation(n, epsilon, in, out);
 
     using X = typename std::invoke_result_t<Fin, size_t>::first_type;
     using Y = typename std::invoke_result_t<Fin, size_t>::second_type;
     using canonical_segment = typename OptimalPiecewiseLinearModel<X, Y>::CanonicalSegment;
-    std::vector<std::vector<canonical_segment>> results(parallelism);
+    using indexed_segment = std::pair<size_t, canonical_segment>; // The index of the first point and the segment
+    std::vector<std::vector<indexed_segment>> results(parallelism);
 
-    #pragma omp parallel for reduction(+:c) num_threads(parallelism)
-    for (auto i = 0; i < parallelism; ++i) {
+    #pragma omp parallel for num_threads(parallelism)
+    for (size_t i = 0; i < parallelism; ++i) {
         auto first = i * chunk_size;
         auto last = i == parallelism - 1 ? n : first + chunk_size;
         if (first > 0) {
             for (; first < last; ++first)
                 if (in(first).first != in(first - 1).first)
                     break;
-            if (first == last)
-                continue;
         }
 
-        auto in_fun = [in, first](auto j) { return in(first + j); };
-        auto out_fun = [&results, i](const auto &cs) { results[i].emplace_back(cs); };
+        auto out_fun = [&results, i](const auto &cs, size_t start, size_t) {
+            results[i].emplace_back(start, cs);
+            return true;
+        };
         results[i].reserve(chunk_size / (epsilon > 0 ? epsilon * epsilon : 16));
-        c += make_segmentation(last - first, epsilon, in_fun, out_fun);
+        make_segmentation_from(first, last, epsilon, in, out_fun);
     }
 
-    for (auto &v : results)
-        for (auto &cs : v)
-            out(cs);
+    // Repair the seams between the chunks, left to right
+    std::vector<canonical_segment> segments;
+    segments.reserve(std::accumulate(results.begin(), results.end(), size_t(0),
+                                     [](size_t sum, const auto &v) { return sum + v.size(); }));
+    size_t chunk = 0;
+    size_t pos = 0;
+    while (chunk < parallelism) {
+        if (pos < results[chunk].size() && (pos + 1 < results[chunk].size() || chunk == parallelism - 1)) {
+            segments.push_back(results[chunk][pos++].second);
+            continue;
+        }
+        if (pos == results[chunk].size()) {
+            ++chunk;
+            pos = 0;
+            continue;
+        }
 
-    return c;
+        // The last segment of this chunk is cut: resume from its start until a segment start is shared with a chunk
+        auto resume_from = results[chunk][pos].first;
+        ++chunk;
+        pos = 0;
+        auto out_fun = [&](const auto &cs, size_t, size_t next_start) {
+            segments.push_back(cs);
+            for (; chunk < parallelism; ++chunk, pos = 0) {
+                auto &v = results[chunk];
+                auto it = std::lower_bound(v.begin() + pos, v.end(), next_start,
+                                           [](const auto &s, size_t k) { return s.first < k; });
+                pos = std::distance(v.begin(), it);
+                if (pos < v.size())
+                    return it->first != next_start;
+            }
+            return true;
+        };
+        make_segmentation_from(resume_from, n, epsilon, in, out_fun);
+    }
+
+    for (auto &cs : segments)
+        out(cs);
+    return segments.size();
 }
 
 template<typename RandomIt>
@@ -356,4 +661,33 @@ auto make_segmentation(RandomIt first, RandomIt last, size_t epsilon) {
     return out;
 }
 
+/**
+ * Fits the coefficients (a, b) of the function f(ε) = aε^b to the given points (ε, f(ε)) by least squares on their
+ * logarithms. This function models the number of segments computed by @ref make_segmentation with error ε.
+ * @param points at least two points with distinct ε
+ * @return the pair (a, b)
+ */
+inline std::pair<double, double> fit_power_law(const std::vector<std::pair<double, double>> &points) {
+    auto count = 0;
+    auto avg_x = 0.;
+    auto avg_y = 0.;
+    auto var_x = 0.;
+    auto cov_xy = 0.;
+
+    for (auto [epsilon, value] : points) {
+        count++;
+        auto x = std::log(epsilon);
+        auto y = std::log(value);
+        auto dx = x - avg_x;
+        avg_x += dx / count;
+        avg_y += (y - avg_y) / count;
+        var_x += dx * (x - avg_x);
+        cov_xy += dx * (y - avg_y);
+    }
+
+    auto b = cov_xy / var_x;
+    auto a = std::exp(avg_y - b * avg_x);
+    return {a, b};
+}
+
 }
\ No newline at end of file
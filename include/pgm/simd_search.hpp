@@ -0,0 +1,165 @@
+// This file is part of PGM-index <https://github.com/gvinciguerra/PGM-index>.
+// Copyright (c) 2018 Giorgio Vinciguerra.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define PGM_SIMD_X86
+#endif
+
+namespace pgm::internal {
+
+/**
+ * Returns the number of elements in the array [first, first + n) that are less than (or, if @p Inclusive is true,
+ * less than or equal to) @p key. The array does not need to be sorted.
+ */
+template<bool Inclusive, typename T>
+size_t scalar_rank(const T *first, size_t n, T key) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; ++i)
+        count += Inclusive ? first[i] <= key : first[i] < key;
+    return count;
+}
+
+#ifdef PGM_SIMD_X86
+
+enum class SimdLevel { Scalar, AVX2, AVX512 };
+
+/** Returns the widest instruction set supported by the CPU, detected on the first call. */
+inline SimdLevel simd_level() {
+    static const auto level = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            return SimdLevel::AVX512;
+        if (__builtin_cpu_supports("avx2"))
+            return SimdLevel::AVX2;
+        return SimdLevel::Scalar;
+    }();
+    return level;
+}
+
+template<bool Inclusive, typename T>
+__attribute__((target("avx2"))) size_t avx2_rank(const T *first, size_t n, T key) {
+    // AVX2 compares only signed integers, so flip the sign bit of unsigned ones to preserve their order
+    using U = std::make_unsigned_t<T>;
+    constexpr auto lanes = 32 / sizeof(T);
+    constexpr auto flip = T(std::is_signed_v<T> ? U(0) : U(U(1) << (sizeof(T) * 8 - 1)));
+
+    __m256i sign_flip, k;
+    if constexpr (sizeof(T) == 4) {
+        sign_flip = _mm256_set1_epi32(int32_t(flip));
+        k = _mm256_set1_epi32(int32_t(key ^ flip));
+    } else {
+        sign_flip = _mm256_set1_epi64x(int64_t(flip));
+        k = _mm256_set1_epi64x(int64_t(key ^ flip));
+    }
+
+    auto accumulator = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + lanes <= n; i += lanes) {
+        auto x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (first + i)), sign_flip);
+        auto a = Inclusive ? x : k;
+        auto b = Inclusive ? k : x;
+        // Each matching lane is -1, so subtracting the comparison result counts the matches lane-wise
+        if constexpr (sizeof(T) == 4)
+            accumulator = _mm256_sub_epi32(accumulator, _mm256_cmpgt_epi32(a, b));
+        else
+            accumulator = _mm256_sub_epi64(accumulator, _mm256_cmpgt_epi64(a, b));
+    }
+
+    alignas(32) U partial[lanes];
+    _mm256_store_si256((__m256i *) partial, accumulator);
+    size_t count = 0;
+    for (auto p : partial)
+        count += p;
+
+    if constexpr (Inclusive)
+        count = i - count;
+    return count + scalar_rank<Inclusive>(first + i, n - i, key);
+}
+
+template<bool Inclusive, typename T>
+__attribute__((target("avx512f"))) size_t avx512_rank(const T *first, size_t n, T key) {
+    constexpr auto lanes = 64 / sizeof(T);
+    constexpr auto predicate = Inclusive ? _MM_CMPINT_LE : _MM_CMPINT_LT;
+    constexpr auto is_signed = std::is_signed_v<T>;
+
+    size_t count = 0;
+    size_t i = 0;
+    if constexpr (sizeof(T) == 4) {
+        auto k = _mm512_set1_epi32(int32_t(key));
+        for (; i + lanes <= n; i += lanes) {
+            auto x = _mm512_loadu_si512(first + i);
+            count += __builtin_popcount(is_signed ? _mm512_cmp_epi32_mask(x, k, predicate)
+                                                  : _mm512_cmp_epu32_mask(x, k, predicate));
+        }
+        if (i < n) {
+            auto tail = __mmask16((1u << (n - i)) - 1);
+            auto x = _mm512_maskz_loadu_epi32(tail, first + i);
+            count += __builtin_popcount(tail & (is_signed ? _mm512_cmp_epi32_mask(x, k, predicate)
+                                                          : _mm512_cmp_epu32_mask(x, k, predicate)));
+        }
+    } else {
+        auto k = _mm512_set1_epi64(int64_t(key));
+        for (; i + lanes <= n; i += lanes) {
+            auto x = _mm512_loadu_si512(first + i);
+            count += __builtin_popcount(is_signed ? _mm512_cmp_epi64_mask(x, k, predicate)
+                                                  : _mm512_cmp_epu64_mask(x, k, predicate));
+        }
+        if (i < n) {
+            auto tail = __mmask8((1u << (n - i)) - 1);
+            auto x = _mm512_maskz_loadu_epi64(tail, first + i);
+            count += __builtin_popcount(tail & (is_signed ? _mm512_cmp_epi64_mask(x, k, predicate)
+                                                          : _mm512_cmp_epu64_mask(x, k, predicate)));
+        }
+    }
+    return count;
+}
+
+#endif
+
+/**
+ * Returns the number of elements in the array [first, first + n) that are less than (or, if @p Inclusive is true,
+ * less than or equal to) @p key, using the widest SIMD instructions supported by the CPU on which the code runs.
+ * The type @p T must be a 32- or 64-bit integer type.
+ */
+template<bool Inclusive, typename T>
+size_t simd_rank(const T *first, size_t n, T key) {
+    static_assert(std::is_integral_v<T> && (sizeof(T) == 4 || sizeof(T) == 8));
+    using U = std::conditional_t<sizeof(T) == 4,
+                                 std::conditional_t<std::is_signed_v<T>, int32_t, uint32_t>,
+                                 std::conditional_t<std::is_signed_v<T>, int64_t, uint64_t>>;
+    auto ptr = reinterpret_cast<const U *>(first);
+#ifdef PGM_SIMD_X86
+    switch (simd_level()) {
+        case SimdLevel::AVX512: return avx512_rank<Inclusive, U>(ptr, n, U(key));
+        case SimdLevel::AVX2: return avx2_rank<Inclusive, U>(ptr, n, U(key));
+        default: break;
+    }
+#endif
+    return scalar_rank<Inclusive, U>(ptr, n, U(key));
+}
+
+/** Checks if @ref simd_rank can be used on the elements of type @p T. */
+template<typename T>
+constexpr bool simd_rank_supported = std::is_integral_v<T> && !std::is_same_v<T, bool>
+                                     && (sizeof(T) == 4 || sizeof(T) == 8);
+
+}
@@ -22,15 +22,21 @@
 #include "utils.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <cmath>
+#include <fstream>
 #include <functional>
+#include <future>
 #include <iterator>
 #include <limits>
 #include <map>
 #include <random>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <utility>
 #include <vector>
@@ -62,9 +68,8 @@ void test_index(const Index &index, const Data &data) {
     REQUIRE(std::lower_bound(lo, hi, q) == data.begin());
 }
 
-TEMPLATE_TEST_CASE("Segmentation algorithm", "", float, double, uint32_t, uint64_t) {
-    auto epsilon = GENERATE(32, 64, 128);
-    auto data = generate_data<TestType>(1000000);
+template<typename Data>
+void test_segmentation(const Data &data, size_t epsilon) {
     auto segments = pgm::internal::make_segmentation(data.begin(), data.end(), epsilon);
     auto it = segments.begin();
     auto [slope, intercept] = it->get_floating_point_segment(it->get_first_x());
@@ -83,6 +88,104 @@ TEMPLATE_TEST_CASE("Segmentation algorithm", "", float, double, uint32_t, uint64
     }
 }
 
+TEMPLATE_TEST_CASE("Segmentation algorithm", "", float, double, uint32_t, uint64_t) {
+    auto epsilon = GENERATE(32, 64, 128);
+    auto data = generate_data<TestType>(1000000);
+    test_segmentation(data, epsilon);
+}
+
+TEMPLATE_TEST_CASE("Segmentation algorithm on wide key ranges", "", int64_t, uint64_t) {
+    // Clusters of close keys, whose slopes fit in 64 bits, separated by gaps that do not
+    std::mt19937_64 gen(42);
+    std::vector<TestType> data;
+    for (auto base : {-(int64_t(1) << 62), int64_t(0), int64_t(1) << 61, int64_t(1) << 62}) {
+        for (auto i = 0; i < 100000; ++i)
+            data.push_back(TestType(base + int64_t(gen() >> 24)));
+        data.push_back(TestType(base + int64_t(gen() >> 3)));
+    }
+    std::sort(data.begin(), data.end());
+    test_segmentation(data, GENERATE(0, 4, 64));
+}
+
+TEMPLATE_TEST_CASE("Parallel segmentation algorithm", "", float, uint32_t, uint64_t) {
+    auto epsilon = GENERATE(0, 4, 64);
+    auto parallelism = GENERATE(2, 3, 8, 64);
+    auto data = generate_data<TestType>(GENERATE(1 << 15, 300000));
+    auto in_fun = [&](auto i) { return std::pair<TestType, size_t>(data[i], i); };
+
+    using canonical_segment = typename pgm::internal::OptimalPiecewiseLinearModel<TestType, size_t>::CanonicalSegment;
+    std::vector<canonical_segment> expected, segments;
+    auto expected_count = pgm::internal::make_segmentation(data.size(), epsilon, in_fun,
+                                                           [&](const auto &cs) { expected.push_back(cs); });
+    auto count = pgm::internal::make_segmentation_par(data.size(), epsilon, in_fun,
+                                                      [&](const auto &cs) { segments.push_back(cs); }, parallelism);
+
+    REQUIRE(count == expected_count);
+    REQUIRE(segments.size() == expected.size());
+    for (size_t i = 0; i < segments.size(); ++i) {
+        auto x = expected[i].get_first_x();
+        REQUIRE(segments[i].get_first_x() == x);
+        REQUIRE(segments[i].get_floating_point_segment(x) == expected[i].get_floating_point_segment(x));
+    }
+}
+
+TEST_CASE("Hull buffer pool") {
+    using pool = pgm::internal::HullBufferPool<uint64_t>;
+    auto v = pool::acquire();
+    v.resize(1000);
+    auto data = v.data();
+    pool::release(std::move(v));
+
+    auto w = pool::acquire();
+    REQUIRE(w.empty());
+    REQUIRE(w.capacity() >= 1000);
+    REQUIRE(w.data() == data);
+
+    w.resize(1u << 20);
+    pool::release(std::move(w));
+    REQUIRE(pool::acquire().capacity() == 0);
+
+    // The holder is destroyed after the pool of its thread, as it was constructed first
+    std::thread([] {
+        struct Holder {
+            std::vector<uint64_t> v;
+            ~Holder() { pool::release(std::move(v)); }
+        };
+        thread_local Holder holder;
+        holder.v = pool::acquire();
+        holder.v.resize(1000);
+    }).join();
+}
+
+TEMPLATE_TEST_CASE("Last-mile search kernels", "", int32_t, uint32_t, int64_t, uint64_t) {
+    auto gen = std::mt19937_64{42};
+    auto rand = std::uniform_int_distribution<TestType>(std::numeric_limits<TestType>::min());
+    auto size = GENERATE(0, 1, 7, 16, 17, 33, 129, 1025);
+    std::vector<TestType> data(size);
+    std::generate(data.begin(), data.end(), [&] { return rand(gen); });
+    std::sort(data.begin(), data.end());
+
+    std::vector<TestType> queries(data.begin(), data.end());
+    for (auto i = 0; i < 100; ++i)
+        queries.push_back(rand(gen));
+    queries.push_back(std::numeric_limits<TestType>::min());
+    queries.push_back(std::numeric_limits<TestType>::max());
+
+    for (auto q : queries) {
+        auto lb = std::lower_bound(data.cbegin(), data.cend(), q);
+        auto ub = std::upper_bound(data.cbegin(), data.cend(), q);
+        REQUIRE(pgm::internal::simd_rank<false>(data.data(), data.size(), q) == size_t(lb - data.cbegin()));
+        REQUIRE(pgm::internal::simd_rank<true>(data.data(), data.size(), q) == size_t(ub - data.cbegin()));
+        REQUIRE(pgm::internal::simd_lower_bound(data.cbegin(), data.cend(), q) == lb);
+#ifdef PGM_SIMD_X86
+        if (__builtin_cpu_supports("avx2")) {
+            REQUIRE(pgm::internal::avx2_rank<false>(data.data(), data.size(), q) == size_t(lb - data.cbegin()));
+            REQUIRE(pgm::internal::avx2_rank<true>(data.data(), data.size(), q) == size_t(ub - data.cbegin()));
+        }
+#endif
+    }
+}
+
 TEMPLATE_TEST_CASE_SIG("PGM-index", "",
                        ((typename T, size_t E1, size_t E2), T, E1, E2),
                        (uint32_t, 8, 0), (uint32_t, 32, 0), (uint32_t, 128, 0),
@@ -91,6 +194,126 @@ TEMPLATE_TEST_CASE_SIG("PGM-index", "",
     auto data = generate_data<T>(2000000);
     pgm::PGMIndex<T, E1, E2> index(data.begin(), data.end());
     test_index(index, data);
+
+    auto rand = std::bind(std::uniform_int_distribution<T>(data.front(), data.back() + 1), std::mt19937{42});
+    std::vector<T> queries(1000);
+    std::generate(queries.begin(), queries.end(), rand);
+    std::vector<pgm::ApproxPos> results(queries.size());
+    index.search_batch(queries.data(), queries.size(), results.data());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        auto expected = index.search(queries[i]);
+        REQUIRE(results[i].pos == expected.pos);
+        REQUIRE(results[i].lo == expected.lo);
+        REQUIRE(results[i].hi == expected.hi);
+    }
+
+    for (auto q : queries) {
+        auto lb = std::lower_bound(data.cbegin(), data.cend(), q);
+        auto ub = std::upper_bound(data.cbegin(), data.cend(), q);
+        REQUIRE(index.lower_bound(data, q) == lb);
+        REQUIRE(index.upper_bound(data, q) == ub);
+        REQUIRE(index.equal_range(data, q) == std::make_pair(lb, ub));
+        REQUIRE(index.find(data, q) == (lb != ub ? lb : data.cend()));
+        REQUIRE(index.contains(data, q) == (lb != ub));
+    }
+}
+
+TEST_CASE("Aligned allocator") {
+    auto policy = GENERATE(pgm::PagePolicy::Regular, pgm::PagePolicy::TransparentHugePages, pgm::PagePolicy::HugePages);
+    pgm::AlignedAllocator<uint64_t> allocator(policy);
+    auto huge_page_size = pgm::AlignedAllocator<uint64_t>::huge_page_size;
+
+    for (size_t n : {1ul, 100ul, huge_page_size / 8, 3 * huge_page_size / 8 + 1}) {
+        auto p = allocator.allocate(n);
+        REQUIRE(reinterpret_cast<uintptr_t>(p) % 64 == 0);
+        if (policy == pgm::PagePolicy::TransparentHugePages && n * 8 >= huge_page_size)
+            REQUIRE(reinterpret_cast<uintptr_t>(p) % huge_page_size == 0);
+        std::fill_n(p, n, 42);
+        REQUIRE(size_t(std::count(p, p + n, 42)) == n);
+        allocator.deallocate(p, n);
+    }
+
+    auto data = generate_data<uint64_t>(2000000);
+    pgm::PGMIndex<uint64_t, 8> index(data, policy);
+    test_index(index, data);
+    auto copy = index;
+    test_index(copy, data);
+}
+
+TEMPLATE_TEST_CASE("PGM-index with 128-bit keys", "", __int128, unsigned __int128) {
+    using K = TestType;
+    std::mt19937_64 engine(42);
+    auto random_key = [&] {
+        auto x = K((unsigned __int128) engine() << 64 | engine());
+        return std::is_signed_v<K> ? x : K(x >> 1);
+    };
+    auto offset = std::numeric_limits<K>::max() / 2;
+    auto data_type = GENERATE(0, 1);
+    std::vector<K> data(1000000);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = data_type == 0 ? random_key() : offset + K(i * 3 + engine() % 3);
+    std::sort(data.begin(), data.end());
+
+    pgm::PGMIndex<K, 32, 4, double> index(data.begin(), data.end());
+    for (auto i = 0; i < 10000; ++i) {
+        auto q = data[engine() % data.size()];
+        auto range = index.search(q);
+        REQUIRE(*std::lower_bound(data.begin() + range.lo, data.begin() + range.hi, q) == q);
+        REQUIRE(index.lower_bound(data, q) == std::lower_bound(data.cbegin(), data.cend(), q));
+    }
+}
+
+TEST_CASE("PGM-index intercept type") {
+    auto data = generate_data<uint32_t>(100000);
+    REQUIRE_THROWS_AS((pgm::PGMIndex<uint32_t, 8, 4, float, int16_t>(data)), std::overflow_error);
+
+    pgm::PGMIndex<uint32_t, 8, 4, float, int64_t> index(data);
+    test_index(index, data);
+    pgm::visit_fixed_height(index, [&](const auto &fixed_index) { test_index(fixed_index, data); });
+}
+
+TEMPLATE_TEST_CASE_SIG("PGM-index rebuild", "", ((size_t E1, size_t E2), E1, E2), (8, 4), (64, 4), (128, 0)) {
+    using Index = pgm::PGMIndex<uint64_t, E1, E2>;
+    auto old_data = generate_data<uint64_t>(1000000);
+    Index old_index(old_data);
+
+    auto same = Index::rebuild(old_index, old_data, old_data, {});
+    REQUIRE(same.segments_count() == old_index.segments_count());
+    REQUIRE(same.height() == old_index.height());
+    for (auto i = 0; i < 10000; ++i) {
+        auto q = old_data[i * 97];
+        REQUIRE(same.search(q).pos == old_index.search(q).pos);
+    }
+
+    // Replace the keys in a few ranges
+    std::mt19937_64 engine(42);
+    std::vector<std::pair<uint64_t, uint64_t>> changed_ranges;
+    auto width = (old_data.back() - old_data.front()) / 1000;
+    auto data = old_data;
+    for (auto i = 0; i < 5; ++i) {
+        auto lo = old_data.front() + engine() % (old_data.back() - old_data.front() - width);
+        changed_ranges.emplace_back(lo, lo + width);
+        auto erase_first = std::lower_bound(data.begin(), data.end(), lo);
+        data.erase(erase_first, std::upper_bound(erase_first, data.end(), lo + width));
+        for (auto j = 0; j < 1000; ++j)
+            data.push_back(lo + engine() % (width + 1));
+        std::sort(data.begin(), data.end());
+    }
+    data.push_back(old_data.back() + 1000);
+    changed_ranges.emplace_back(old_data.back() + 1, old_data.back() + 1000);
+
+    auto index = Index::rebuild(old_index, old_data, data, changed_ranges);
+    test_index(index, data);
+    for (auto i = 0; i < 10000; ++i) {
+        auto q = old_data.front() + engine() % (old_data.back() - old_data.front());
+        REQUIRE(index.lower_bound(data, q) == std::lower_bound(data.cbegin(), data.cend(), q));
+    }
+    Index fresh(data);
+    REQUIRE(index.segments_count() <= fresh.segments_count() + 20);
+
+    auto full = Index::rebuild(old_index, old_data, data, {{0, std::numeric_limits<uint64_t>::max()}});
+    REQUIRE(full.segments_count() <= fresh.segments_count());
+    test_index(full, data);
 }
 
 TEMPLATE_TEST_CASE_SIG("Compressed PGM-index", "", ((size_t E), E), 8, 32, 128) {
@@ -119,6 +342,389 @@ TEMPLATE_TEST_CASE_SIG("Elias-Fano PGM-index", "", ((size_t E), E), 8, 32, 128)
     test_index(index, data);
 }
 
+TEMPLATE_TEST_CASE_SIG("SoA PGM-index", "",
+                       ((typename T, size_t E1, size_t E2), T, E1, E2),
+                       (uint32_t, 8, 0), (uint32_t, 32, 4), (uint64_t, 64, 4), (uint64_t, 32, 16),
+                       (uint64_t, 128, 128)) {
+    auto data = generate_data<T>(2000000);
+    pgm::SoAPGMIndex<T, E1, E2> index(data.begin(), data.end());
+    test_index(index, data);
+
+    pgm::PGMIndex<T, E1, E2> expected_index(data.begin(), data.end());
+    REQUIRE(index.height() == expected_index.height());
+    REQUIRE(index.segments_count() == expected_index.segments_count());
+    auto rand = std::bind(std::uniform_int_distribution<T>(data.front(), data.back()), std::mt19937{42});
+    for (auto i = 0; i < 10000; ++i) {
+        auto q = rand();
+        REQUIRE(index.search(q).pos == expected_index.search(q).pos);
+    }
+}
+
+TEMPLATE_TEST_CASE_SIG("B+-tree PGM-index", "",
+                       ((typename T, size_t E), T, E), (uint32_t, 8), (uint32_t, 64), (uint64_t, 16), (uint64_t, 256)) {
+    auto data = generate_data<T>(GENERATE(1, 10, 2000000));
+    pgm::BTreePGMIndex<T, E> index(data.begin(), data.end());
+    test_index(index, data);
+
+    pgm::OneLevelPGMIndex<T, E> expected_index(data.begin(), data.end());
+    REQUIRE(index.segments_count() == expected_index.segments_count());
+    auto rand = std::bind(std::uniform_int_distribution<T>(0, data.back() + 1), std::mt19937{42});
+    for (auto i = 0; i < 10000; ++i) {
+        auto q = rand();
+        REQUIRE(index.search(q).pos == expected_index.search(q).pos);
+    }
+
+    // The top of the key domain, also when it is in the data
+    auto max = std::numeric_limits<T>::max();
+    auto range = index.search(max);
+    REQUIRE(std::lower_bound(data.begin() + range.lo, data.begin() + range.hi, max) == data.end());
+    data.push_back(max);
+    pgm::BTreePGMIndex<T, E> index_with_max(data.begin(), data.end());
+    for (auto q : {data.front(), data[data.size() / 2], max}) {
+        range = index_with_max.search(q);
+        REQUIRE(*std::lower_bound(data.begin() + range.lo, data.begin() + range.hi, q) == q);
+    }
+}
+
+TEMPLATE_TEST_CASE_SIG("Quadratic PGM-index", "",
+                       ((typename T, size_t E1, size_t E2), T, E1, E2),
+                       (uint32_t, 8, 0), (uint32_t, 32, 4), (uint64_t, 64, 8), (int64_t, 128, 2)) {
+    auto data = generate_data<T>(GENERATE(1, 10, 1000000));
+    pgm::QuadraticPGMIndex<T, E1, E2> index(data.begin(), data.end());
+    test_index(index, data);
+
+    auto rand = std::bind(std::uniform_int_distribution<T>(data.front(), data.back() + 1), std::mt19937{42});
+    for (auto i = 0; i < 10000; ++i) {
+        auto q = rand();
+        auto range = index.search(q);
+        auto it = std::lower_bound(data.begin() + range.lo, data.begin() + range.hi, q);
+        REQUIRE(it == std::lower_bound(data.begin(), data.end(), q));
+    }
+}
+
+TEST_CASE("Quadratic PGM-index on skewed data") {
+    std::vector<uint64_t> data(1000000);
+    std::mt19937_64 engine(42);
+    std::lognormal_distribution<double> lognormal(0, 2);
+    std::generate(data.begin(), data.end(), [&] { return uint64_t(lognormal(engine) * 1e6); });
+    std::sort(data.begin(), data.end());
+
+    pgm::QuadraticPGMIndex<uint64_t, 64> index(data);
+    pgm::PGMIndex<uint64_t, 64> linear_index(data);
+    test_index(index, data);
+    REQUIRE(index.segments_count() < linear_index.segments_count());
+    REQUIRE(index.size_in_bytes() < linear_index.size_in_bytes());
+}
+
+TEMPLATE_TEST_CASE_SIG("Runtime PGM-index", "",
+                       ((typename T, size_t E1, size_t E2), T, E1, E2),
+                       (uint32_t, 8, 0), (uint32_t, 32, 4), (uint64_t, 64, 8), (int64_t, 128, 2)) {
+    auto data = generate_data<T>(GENERATE(1, 10, 1000000));
+    pgm::RuntimePGMIndex<T, E2> index(data, E1);
+    pgm::PGMIndex<T, E1, E2> expected_index(data);
+    test_index(index, data);
+    REQUIRE(index.epsilon_value() == E1);
+    REQUIRE(index.segments_count() == expected_index.segments_count());
+    REQUIRE(index.size_in_bytes() == expected_index.size_in_bytes());
+
+    auto rand = std::bind(std::uniform_int_distribution<T>(data.front(), data.back()), std::mt19937{42});
+    for (auto i = 0; i < 10000; ++i) {
+        auto q = rand();
+        auto range = index.search(q);
+        auto expected_range = expected_index.search(q);
+        REQUIRE(range.pos == expected_range.pos);
+        REQUIRE(range.lo == expected_range.lo);
+        REQUIRE(range.hi == expected_range.hi);
+        REQUIRE(index.lower_bound(data, q) == expected_index.lower_bound(data, q));
+    }
+}
+
+TEST_CASE("Runtime PGM-index with a space budget") {
+    auto data = generate_data<uint64_t>(2000000);
+    auto max_bytes = GENERATE(size_t(1) << 10, size_t(1) << 14, size_t(1) << 18);
+
+    auto index = pgm::RuntimePGMIndex<uint64_t>::with_space_budget(data, max_bytes);
+    test_index(index, data);
+    REQUIRE(index.size_in_bytes() <= max_bytes);
+    if (index.epsilon_value() > 1) {
+        // The estimate should not pick an Epsilon much larger than the smallest one that fits
+        pgm::RuntimePGMIndex<uint64_t> smaller_index(data, index.epsilon_value() / 2);
+        REQUIRE(smaller_index.size_in_bytes() > max_bytes);
+    }
+
+    REQUIRE_THROWS_AS(pgm::RuntimePGMIndex<uint64_t>::with_space_budget(data, 8), std::invalid_argument);
+    REQUIRE_THROWS_AS(pgm::RuntimePGMIndex<uint64_t>(data, 0), std::invalid_argument);
+}
+
+TEMPLATE_TEST_CASE("Variable-epsilon PGM-index", "", uint32_t, uint64_t, int64_t) {
+    auto data = generate_data<TestType>(GENERATE(1, 10, 1000000));
+    auto middle = data[data.size() / 2];
+    auto epsilon_for_key = [&](const TestType &k) { return k < middle ? 8 : 256; };
+    pgm::VariableEpsilonPGMIndex<TestType> index(data.begin(), data.end(), epsilon_for_key);
+    test_index(index, data);
+
+    auto rand = std::bind(std::uniform_int_distribution<TestType>(data.front(), data.back() + 1), std::mt19937{42});
+    for (auto i = 0; i < 10000; ++i) {
+        auto q = rand();
+        auto range = index.search(q);
+        REQUIRE(range.hi - range.lo <= 2 * 256 + 2);
+        REQUIRE(index.lower_bound(data, q) == std::lower_bound(data.begin(), data.end(), q));
+    }
+
+    using Index = pgm::VariableEpsilonPGMIndex<TestType>;
+    REQUIRE_THROWS_AS(Index(data.begin(), data.end(), [](auto) { return 0; }), std::invalid_argument);
+}
+
+TEST_CASE("Variable-epsilon PGM-index from a query sample") {
+    std::vector<uint64_t> data(2000000);
+    std::mt19937_64 engine(42);
+    std::generate(data.begin(), data.end(), [&] { return engine() >> 16; });
+    std::sort(data.begin(), data.end());
+
+    // A tenth of the keys receives nine tenths of the queries
+    std::vector<uint64_t> queries(100000);
+    auto hot_begin = data.size() / 2;
+    auto hot_size = data.size() / 10;
+    for (size_t i = 0; i < queries.size(); ++i)
+        queries[i] = i % 10 ? data[hot_begin + engine() % hot_size] : data[engine() % data.size()];
+
+    pgm::VariableEpsilonPGMIndex<uint64_t> index(data.begin(), data.end(), 64, queries);
+    pgm::PGMIndex<uint64_t, 64> uniform_index(data);
+    test_index(index, data);
+    REQUIRE(index.size_in_bytes() < uniform_index.size_in_bytes() * 1.25);
+
+    size_t range_sum = 0;
+    size_t uniform_range_sum = 0;
+    for (auto q : queries) {
+        auto range = index.search(q);
+        auto uniform_range = uniform_index.search(q);
+        REQUIRE(*std::lower_bound(data.begin() + range.lo, data.begin() + range.hi, q) == q);
+        range_sum += range.hi - range.lo;
+        uniform_range_sum += uniform_range.hi - uniform_range.lo;
+    }
+    REQUIRE(range_sum < uniform_range_sum * 0.8);
+
+    // Without queries, every region gets the given epsilon
+    pgm::VariableEpsilonPGMIndex<uint64_t> unsampled_index(data.begin(), data.end(), 64, {});
+    pgm::VariableEpsilonPGMIndex<uint64_t> constant_index(data.begin(), data.end(), [](auto) { return 64; });
+    test_index(unsampled_index, data);
+    REQUIRE(unsampled_index.segments_count() == constant_index.segments_count());
+
+    using Index = pgm::VariableEpsilonPGMIndex<uint64_t>;
+    REQUIRE_THROWS_AS(Index(data.begin(), data.end(), 0, queries), std::invalid_argument);
+    REQUIRE_THROWS_AS(Index(data.begin(), data.end(), 65536, queries), std::invalid_argument);
+}
+
+TEMPLATE_TEST_CASE_SIG("Fixed-height PGM-index", "",
+                       ((typename T, size_t E1, size_t E2), T, E1, E2),
+                       (uint32_t, 8, 0), (uint32_t, 8, 1), (uint32_t, 32, 4), (uint64_t, 64, 8), (uint64_t, 16, 128)) {
+    auto data = generate_data<T>(GENERATE(1, 100, 2000000));
+    pgm::PGMIndex<T, E1, E2> index(data.begin(), data.end());
+    auto rand = std::bind(std::uniform_int_distribution<T>(0, data.back() + 1), std::mt19937{42});
+
+    pgm::visit_fixed_height(index, [&](const auto &fixed_index) {
+        REQUIRE(fixed_index.height() == index.height());
+        REQUIRE(fixed_index.segments_count() == index.segments_count());
+        test_index(fixed_index, data);
+        for (auto i = 0; i < 10000; ++i) {
+            auto q = rand();
+            REQUIRE(fixed_index.search(q).pos == index.search(q).pos);
+        }
+    });
+}
+
+TEMPLATE_TEST_CASE("Encoded PGM-index with floating-point keys", "", float, double) {
+    std::vector<TestType> data(GENERATE(1, 100, 1000000));
+    std::mt19937 gen(42);
+    std::normal_distribution<TestType> distribution(0, 1000);
+    std::generate(data.begin(), data.end(), [&] { return distribution(gen); });
+    data.insert(data.end(), {-0.0, 0.0, 0.0, std::numeric_limits<TestType>::lowest()});
+    std::sort(data.begin(), data.end());
+
+    pgm::EncodedPGMIndex<TestType, 32> index(data);
+    for (auto i = 0; i < 10000; ++i) {
+        auto q = i % 100 == 0 ? TestType(-0.0) : i % 2 ? data[gen() % data.size()] : distribution(gen);
+        REQUIRE(index.lower_bound(data, q) == std::lower_bound(data.begin(), data.end(), q));
+        REQUIRE(index.upper_bound(data, q) == std::upper_bound(data.begin(), data.end(), q));
+        auto approx_range = index.search(q);
+        auto lb = std::lower_bound(data.begin(), data.end(), q);
+        REQUIRE(std::distance(data.begin(), lb) >= (long) approx_range.lo);
+        REQUIRE(std::distance(data.begin(), lb) <= (long) approx_range.hi);
+    }
+}
+
+TEMPLATE_TEST_CASE("Encoded PGM-index with string keys", "", uint64_t, unsigned __int128) {
+    std::vector<std::string> data;
+    std::mt19937 gen(42);
+    std::vector<std::string> prefixes = {"", "http://", "https://www.", "https://www.example.com/"};
+    for (auto i = 0; i < 100000; ++i) {
+        auto s = prefixes[gen() % prefixes.size()];
+        for (auto len = gen() % 12; len > 0; --len)
+            s.push_back(char('a' + gen() % 4));
+        data.push_back(s);
+    }
+    std::sort(data.begin(), data.end());
+
+    using traits = pgm::StringPrefixTraits<TestType>;
+    pgm::EncodedPGMIndex<std::string, 16, 4, float, traits> index(data);
+    for (auto i = 0; i < 10000; ++i) {
+        auto q = data[gen() % data.size()];
+        if (i % 2 && !q.empty())
+            q.back() = char('a' + gen() % 5);
+        REQUIRE(index.lower_bound(data, q) == std::lower_bound(data.begin(), data.end(), q));
+        REQUIRE(index.upper_bound(data, q) == std::upper_bound(data.begin(), data.end(), q));
+        REQUIRE(index.contains(data, q) == std::binary_search(data.begin(), data.end(), q));
+    }
+}
+
+TEMPLATE_TEST_CASE_SIG("PGM-index builder", "",
+                       ((typename T, size_t E1, size_t E2), T, E1, E2),
+                       (uint32_t, 8, 0), (uint32_t, 32, 4), (uint64_t, 64, 8), (int64_t, 128, 2)) {
+    auto data = generate_data<T>(GENERATE(1, 2, 30000));
+    if (GENERATE(false, true) && data.size() > 1)
+        data.back() = std::numeric_limits<T>::max();
+
+    // On less than 2^15 keys, PGMIndex builds the segments sequentially, so the two indexes must be identical
+    pgm::PGMIndex<T, E1, E2> expected_index(data);
+    pgm::PGMIndexBuilder<T, E1, E2> builder;
+    builder.push(data.begin(), data.begin() + data.size() / 2);
+    for (auto it = data.begin() + data.size() / 2; it != data.end(); ++it)
+        builder.push(*it);
+    REQUIRE(builder.size() == data.size());
+
+    auto index = builder.finish();
+    REQUIRE(builder.size() == 0);
+    REQUIRE(index.height() == expected_index.height());
+    REQUIRE(index.segments_count() == expected_index.segments_count());
+    REQUIRE(index.size_in_bytes() == expected_index.size_in_bytes());
+    auto max_query = std::min<T>(data.back(), std::numeric_limits<T>::max() - 1); // max() is the sentinel value
+    auto rand = std::bind(std::uniform_int_distribution<T>(data.front(), max_query), std::mt19937{42});
+    for (auto i = 0; i < 10000; ++i) {
+        auto q = rand();
+        REQUIRE(index.search(q).pos == expected_index.search(q).pos);
+    }
+
+    builder.push(T(1));
+    REQUIRE_THROWS_AS(builder.push(T(0)), std::invalid_argument);
+}
+
+TEST_CASE("PGM-index builder from a stream") {
+    auto data = generate_data<uint64_t>(1000000);
+    std::stringstream stream;
+    for (auto x : data)
+        stream << x << ' ';
+
+    pgm::PGMIndexBuilder<uint64_t, 32> builder;
+    builder.push(std::istream_iterator<uint64_t>(stream), std::istream_iterator<uint64_t>());
+    auto index = builder.finish();
+    test_index(index, data);
+}
+
+TEMPLATE_TEST_CASE_SIG("PGM-index view", "",
+                       ((typename T, size_t E1, size_t E2), T, E1, E2),
+                       (uint32_t, 8, 0), (uint32_t, 32, 4), (uint64_t, 64, 8), (int64_t, 128, 64)) {
+    auto data = generate_data<T>(GENERATE(1, 1000000));
+    pgm::PGMIndex<T, E1, E2> index(data);
+
+    std::stringstream stream;
+    index.save(stream);
+    auto saved = stream.str();
+    std::vector<uint64_t> buffer(saved.size() / sizeof(uint64_t) + 1);
+    std::memcpy(buffer.data(), saved.data(), saved.size());
+
+    pgm::PGMIndexView<T, E1, E2> view(buffer.data(), saved.size());
+    REQUIRE(view.height() == index.height());
+    REQUIRE(view.segments_count() == index.segments_count());
+    REQUIRE(view.size_in_bytes() == index.size_in_bytes());
+    test_index(view, data);
+
+    std::string tmp_filename = "tmp.view.pgm";
+    {
+        std::ofstream out(tmp_filename, std::ios::binary);
+        index.save(out);
+    }
+    auto rand = std::bind(std::uniform_int_distribution<T>(0, data.back() + 1), std::mt19937{42});
+    pgm::PGMIndexView<T, E1, E2> mapped_view(tmp_filename);
+    auto moved_view = std::move(mapped_view);
+    for (auto i = 0; i < 10000; ++i) {
+        auto q = rand();
+        REQUIRE(moved_view.search(q).pos == index.search(q).pos);
+        REQUIRE(moved_view.lower_bound(data.begin(), data.end(), q) == index.lower_bound(data, q));
+        REQUIRE(moved_view.upper_bound(data.begin(), data.end(), q) == index.upper_bound(data, q));
+    }
+    std::remove(tmp_filename.c_str());
+
+    using OtherView = pgm::PGMIndexView<T, E1 * 2, E2>;
+    REQUIRE_THROWS_AS(OtherView(buffer.data(), saved.size()), std::invalid_argument);
+    REQUIRE_THROWS_AS((pgm::PGMIndexView<T, E1, E2>(buffer.data(), saved.size() / 2)), std::invalid_argument);
+
+    // Edit the header and the level offsets of a copy of the buffer, then open a view on it
+    auto open_corrupted = [&](auto edit) {
+        auto copy = buffer;
+        pgm::internal::SerializedHeader header;
+        std::memcpy(&header, copy.data(), sizeof(header));
+        auto offsets = reinterpret_cast<char *>(copy.data()) + header.levels_offsets_position;
+        edit(header, reinterpret_cast<size_t *>(offsets));
+        std::memcpy(copy.data(), &header, sizeof(header));
+        pgm::PGMIndexView<T, E1, E2> corrupted(copy.data(), saved.size());
+    };
+    auto overflowing_count = uint64_t(1) << 62;
+    REQUIRE_THROWS_AS(open_corrupted([&](auto &h, auto) { h.segments_count = overflowing_count; }),
+                      std::invalid_argument);
+    REQUIRE_THROWS_AS(open_corrupted([&](auto &h, auto) { h.levels_offsets_count = overflowing_count; }),
+                      std::invalid_argument);
+    REQUIRE_THROWS_AS(open_corrupted([](auto &h, auto offsets) { offsets[1] = h.segments_count + 1; }),
+                      std::invalid_argument);
+    REQUIRE_THROWS_AS(open_corrupted([](auto &, auto offsets) { offsets[0] = offsets[1]; }), std::invalid_argument);
+
+    // The segments are not validated on opening, but the searches on corrupted ones stay within the buffer
+    for (auto byte : {0x00, 0x7f, 0xff}) {
+        auto copy = buffer;
+        pgm::internal::SerializedHeader header;
+        std::memcpy(&header, copy.data(), sizeof(header));
+        auto segments = reinterpret_cast<char *>(copy.data()) + header.segments_position;
+        std::memset(segments, byte, header.segments_count * header.segment_size);
+        pgm::PGMIndexView<T, E1, E2> corrupted(copy.data(), saved.size());
+        for (auto i = 0; i < 1000; ++i) {
+            auto range = corrupted.search(rand());
+            REQUIRE(range.lo <= range.hi);
+            REQUIRE(range.hi <= data.size());
+        }
+    }
+}
+
+TEMPLATE_TEST_CASE_SIG("Append-only PGM-index", "",
+                       ((typename T, size_t E1, size_t E2), T, E1, E2),
+                       (uint32_t, 8, 0), (uint32_t, 32, 4), (uint64_t, 64, 8), (int64_t, 128, 2)) {
+    auto data = generate_data<T>(300000);
+    data.erase(std::unique(data.begin(), data.end()), data.end());
+
+    pgm::AppendOnlyPGMIndex<T, E1, E2> index;
+    REQUIRE(index.empty());
+    REQUIRE(index.lower_bound(data.front()) == index.end());
+
+    auto rand = std::bind(std::uniform_int_distribution<T>(0, data.back()), std::mt19937{42});
+    for (size_t appended = 0; appended < data.size();) {
+        auto count = std::min<size_t>(data.size() - appended, 1 + appended / 2);
+        index.append(data.begin() + appended, data.begin() + appended + count);
+        appended += count;
+        REQUIRE(index.size() == appended);
+
+        auto last = data.begin() + appended;
+        for (auto i = 0; i < 1000; ++i) {
+            auto q = i % 2 ? data[rand() % appended] : rand();
+            auto expected = std::lower_bound(data.begin(), last, q);
+            REQUIRE(index.lower_bound(q) - index.begin() == expected - data.begin());
+            REQUIRE(index.contains(q) == (expected != last && *expected == q));
+        }
+    }
+
+    auto in_fun = [&](auto i) { return std::pair<T, size_t>(data[i], i); };
+    REQUIRE(index.segments_count() == pgm::internal::make_segmentation(data.size(), E1, in_fun, [](auto) {}));
+    REQUIRE(index.upper_bound(data.back()) == index.end());
+    REQUIRE_THROWS_AS(index.push_back(data.back()), std::invalid_argument);
+}
+
 TEMPLATE_TEST_CASE_SIG("Mapped PGM-index", "", ((size_t E), E), 8, 32, 128) {
     std::string tmp_filename = "tmp.mapped.pgm";
     auto data = generate_data<uint32_t>(500000);
@@ -246,6 +852,193 @@ TEMPLATE_TEST_CASE("Dynamic PGM-index", "", uint32_t*, uint32_t, std::string) {
     }
 }
 
+TEST_CASE("Dynamic PGM-index bulk updates") {
+    auto make_key = std::bind(std::uniform_int_distribution<uint32_t>(0, 10000000), std::mt19937{42});
+    std::vector<std::pair<uint32_t, uint32_t>> bulk(GENERATE(0, 100000));
+    std::generate(bulk.begin(), bulk.end(), [&] { return std::make_pair(make_key(), make_key()); });
+    std::sort(bulk.begin(), bulk.end());
+    bulk.erase(std::unique(bulk.begin(), bulk.end(), [](auto &a, auto &b) { return a.first == b.first; }), bulk.end());
+
+    auto track_size = GENERATE(false, true);
+    pgm::DynamicPGMIndex<uint32_t, uint32_t> pgm(bulk.begin(), bulk.end(), GENERATE(2, 8), 0, 0, 0, track_size);
+    std::map<uint32_t, uint32_t> map(bulk.begin(), bulk.end());
+
+    for (auto batch_size : {1, 10, 1000, 100000, 50, 300000, 7}) {
+        // An unsorted batch with repeated keys, where the last value of a key wins
+        std::vector<std::pair<uint32_t, uint32_t>> batch(batch_size);
+        std::generate(batch.begin(), batch.end(), [&] { return std::make_pair(make_key(), make_key()); });
+        for (size_t i = 1; i < batch.size(); i += 3)
+            batch[i].first = batch[i - 1].first;
+        if (batch_size % 2)
+            std::sort(batch.begin(), batch.end(), [](auto &a, auto &b) { return a.first < b.first; });
+        pgm.bulk_upsert(batch.begin(), batch.end());
+        for (auto [k, v] : batch)
+            map.insert_or_assign(k, v);
+
+        std::vector<uint32_t> keys(batch_size / 3);
+        std::generate(keys.begin(), keys.end(), [&] { return batch[make_key() % batch.size()].first; });
+        pgm.bulk_erase(keys.begin(), keys.end());
+        for (auto k : keys)
+            map.erase(k);
+
+        auto k = make_key();
+        pgm.insert_or_assign(k, 42);
+        map.insert_or_assign(k, 42);
+        REQUIRE(pgm.size() == map.size());
+    }
+
+    auto it = pgm.begin();
+    for (auto [k, v] : map) {
+        REQUIRE(it->first == k);
+        REQUIRE(it->second == v);
+        ++it;
+    }
+    REQUIRE(it == pgm.end());
+    REQUIRE(size_t(std::distance(pgm.begin(), pgm.end())) == pgm.size());
+    for (auto i = 0; i < 10000; ++i) {
+        auto q = make_key();
+        REQUIRE((pgm.find(q) == pgm.end()) == (map.find(q) == map.end()));
+    }
+
+    std::vector<uint32_t> keys;
+    for (auto [k, v] : map)
+        keys.push_back(k);
+    pgm.erase(keys.back());
+    pgm.bulk_erase(keys.begin(), keys.end());
+    pgm.erase(keys.front());
+    REQUIRE(pgm.size() == 0);
+    REQUIRE(pgm.empty());
+    REQUIRE(pgm.begin() == pgm.end());
+}
+
+TEST_CASE("Dynamic PGM-index with level filters") {
+    auto make_key = std::bind(std::uniform_int_distribution<uint32_t>(0, 10000000), std::mt19937{42});
+    std::vector<std::pair<uint32_t, uint32_t>> bulk(GENERATE(0, 100000));
+    std::generate(bulk.begin(), bulk.end(), [&] { return std::make_pair(make_key(), make_key()); });
+    std::sort(bulk.begin(), bulk.end());
+    bulk.erase(std::unique(bulk.begin(), bulk.end(), [](auto &a, auto &b) { return a.first == b.first; }), bulk.end());
+
+    auto filter_bits = GENERATE(0, 4, 10);
+    pgm::DynamicPGMIndex<uint32_t, uint32_t> pgm(bulk.begin(), bulk.end(), 8, 0, 0, filter_bits);
+    std::map<uint32_t, uint32_t> map(bulk.begin(), bulk.end());
+
+    for (uint32_t i = 0; i < 200000; ++i) {
+        auto k = i < bulk.size() && i % 3 == 0 ? bulk[i].first : make_key();
+        if (i % 5 == 0) {
+            pgm.erase(k);
+            map.erase(k);
+        } else {
+            pgm.insert_or_assign(k, i);
+            map.insert_or_assign(k, i);
+        }
+    }
+
+    for (auto [k, v] : map) {
+        auto it = pgm.find(k);
+        REQUIRE(it != pgm.end());
+        REQUIRE(it->second == v);
+    }
+    for (auto i = 0; i < 100000; ++i) {
+        auto q = make_key();
+        REQUIRE((pgm.find(q) == pgm.end()) == (map.find(q) == map.end()));
+    }
+}
+
+TEST_CASE("Concurrent dynamic PGM-index") {
+    auto make_key = std::bind(std::uniform_int_distribution<uint32_t>(0, 1000000000), std::mt19937{42});
+    std::vector<std::pair<uint32_t, uint32_t>> bulk(GENERATE(0, 1000, 100000));
+    std::generate(bulk.begin(), bulk.end(), [&] { return std::make_pair(make_key(), make_key()); });
+    std::sort(bulk.begin(), bulk.end());
+    bulk.erase(std::unique(bulk.begin(), bulk.end(), [](auto &a, auto &b) { return a.first == b.first; }), bulk.end());
+
+    auto max_frozen_buffers = GENERATE(0, 2);
+    pgm::ConcurrentDynamicPGMIndex<uint32_t, uint32_t> pgm(bulk.begin(), bulk.end(), GENERATE(2, 8), 0, 0,
+                                                           max_frozen_buffers);
+    std::map<uint32_t, uint32_t> map(bulk.begin(), bulk.end());
+    for (size_t i = 0; i < 20000; ++i) {
+        auto k = i < bulk.size() && i % 2 ? bulk[i].first : make_key();
+        auto v = make_key();
+        pgm.insert_or_assign(k, v);
+        map.insert_or_assign(k, v);
+        if (i % 5 == 0) {
+            auto e = i < bulk.size() ? bulk[i / 2].first : make_key();
+            pgm.erase(e);
+            map.erase(e);
+        }
+    }
+
+    auto snapshot = pgm.snapshot();
+    pgm.insert_or_assign(map.begin()->first, 42);
+    REQUIRE(pgm.find(map.begin()->first) == 42);
+    REQUIRE(snapshot.find(map.begin()->first) == map.begin()->second);
+
+    for (auto i = 0; i < 10000; ++i) {
+        auto q = make_key();
+        auto map_it = map.lower_bound(q);
+        auto lb = snapshot.lower_bound(q);
+        REQUIRE(lb.has_value() == (map_it != map.end()));
+        if (lb) {
+            REQUIRE(lb->first == map_it->first);
+            REQUIRE(lb->second == map_it->second);
+        }
+        if (map_it != map.end())
+            REQUIRE(snapshot.find(map_it->first) == map_it->second);
+        REQUIRE(snapshot.contains(q) == map.count(q));
+    }
+
+    for (int i = 0; i < 10; ++i) {
+        auto lo = make_key();
+        auto hi = lo + make_key() / 2;
+        auto range_result = snapshot.range(lo, hi);
+        auto map_it = map.lower_bound(lo);
+        REQUIRE(range_result.size() == size_t(std::distance(map_it, map.upper_bound(hi))));
+        for (auto [k, v] : range_result) {
+            REQUIRE(k == map_it->first);
+            REQUIRE(v == map_it->second);
+            ++map_it;
+        }
+    }
+}
+
+TEST_CASE("Concurrent dynamic PGM-index with concurrent readers") {
+    // The even keys are always present, the odd keys are inserted in increasing order by the writer
+    std::vector<std::pair<uint32_t, uint32_t>> bulk(100000);
+    for (uint32_t i = 0; i < bulk.size(); ++i)
+        bulk[i] = {2 * i, i};
+    pgm::ConcurrentDynamicPGMIndex<uint32_t, uint32_t> pgm(bulk.begin(), bulk.end(), 4, 0, 0, GENERATE(0, 1, 4));
+    std::atomic<uint32_t> written(0);
+
+    auto reader = [&](uint32_t seed) {
+        std::mt19937 engine(seed);
+        size_t errors = 0;
+        while (written.load() < bulk.size()) {
+            auto count = written.load();
+            auto snapshot = pgm.snapshot();
+            auto i = uint32_t(engine() % bulk.size());
+            errors += snapshot.find(2 * i) != i;
+            errors += pgm.find(2 * i) != i;
+            if (count > 0) {
+                auto j = uint32_t(engine() % count);
+                errors += snapshot.find(2 * j + 1) != j;
+                errors += pgm.find(2 * j + 1) != j;
+                errors += !pgm.lower_bound(2 * j + 1).has_value();
+            }
+        }
+        return errors;
+    };
+
+    std::vector<std::future<size_t>> readers;
+    for (uint32_t seed = 0; seed < 3; ++seed)
+        readers.push_back(std::async(std::launch::async, reader, seed));
+    for (uint32_t i = 0; i < bulk.size(); ++i) {
+        pgm.insert_or_assign(2 * i + 1, i);
+        written.store(i + 1);
+    }
+    for (auto &r : readers)
+        REQUIRE(r.get() == 0);
+    REQUIRE(pgm.range(0, 2 * bulk.size()).size() == 2 * bulk.size());
+}
+
 #ifdef MORTON_ND_BMI2_ENABLED
 
 TEMPLATE_TEST_CASE_SIG("Multidimensional PGM-index", "",
@@ -112,31 +112,10 @@ struct IndexStats {
 
 /** Fits the coefficients (a,b) of a function f(ε)=aε^b. */
 auto fit_segments_count_model(const std::vector<IndexStats> &all_index_stats) {
-    auto count = 0;
-    auto avg_y = 0.;
-    auto avg_x = 0.;
-    auto var_x = 0.;
-    auto var_y = 0.;
-    auto cov_xy = 0.;
-
-    for (const auto &stats: all_index_stats) {
-        count++;
-        auto x = std::log(stats.epsilon);
-        auto y = std::log(stats.segments_count);
-        auto dx = x - avg_x;
-        auto dy = y - avg_y;
-        avg_x += dx / count;
-        avg_y += dy / count;
-        var_x += dx * (x - avg_x);
-        var_y += dy * (y - avg_y);
-        cov_xy += dx * (y - avg_y);
-    }
-
-    var_x /= (count - 1);
-    cov_xy /= (count - 1);
-    auto b = cov_xy / var_x;
-    auto a = std::exp(avg_y - b * avg_x);
-    return std::make_pair(a, b);
+    std::vector<std::pair<double, double>> points;
+    for (const auto &stats: all_index_stats)
+        points.emplace_back(stats.epsilon, stats.segments_count);
+    return pgm::internal::fit_power_law(points);
 }
 
 /*------- ROOT FINDING -------*/